@@ -0,0 +1,275 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+// Generates synthetic firmware reports and board descriptions for
+// benchmarking cheriot-audit.  The generated images have the same structure
+// as the linker's reports (the RTOS core compartments, shared objects,
+// threads, and compartments with call, library, MMIO and sealed-object
+// imports) but an arbitrary number of compartments.
+
+#include <CLI/CLI.hpp>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace
+{
+	/// Base address for shared objects.
+	constexpr uint32_t SharedObjectBase = 0x80040000;
+
+	/// Devices in the generated board description.
+	const std::vector<std::pair<std::string, uint32_t>> Devices = {
+	  {"clint", 0x2000000},
+	  {"plic", 0xc000000},
+	  {"revoker", 0x8f000000},
+	  {"uart", 0x10000000},
+	};
+
+	/**
+	 * Generate a fake SHA-256 hash from a string, so that every section has a
+	 * distinct, stable hash.
+	 */
+	std::string fake_hash(const std::string &seed)
+	{
+		std::mt19937_64   rng(std::hash<std::string>{}(seed));
+		std::stringstream ss;
+		ss << std::hex;
+		for (int i = 0; i < 4; i++)
+		{
+			ss.width(16);
+			ss.fill('0');
+			ss << rng();
+		}
+		return ss.str();
+	}
+
+	/**
+	 * Returns the mangled name of the `index`th function exported by a
+	 * compartment, which demangles to `entry<index>()`.
+	 */
+	std::string mangled_entry(size_t index)
+	{
+		std::string name = "entry" + std::to_string(index);
+		return "_Z" + std::to_string(name.size()) + name + "v";
+	}
+
+	std::string compartment_file(const std::string &name)
+	{
+		return "build/" + name + ".compartment";
+	}
+
+	nlohmann::json code_section(const std::string &name)
+	{
+		return {{"inputs",
+		         {{{"file", compartment_file(name)},
+		           {"section_name", ".text"},
+		           {"sha256", fake_hash(name + ".text")},
+		           {"size", 4096}}}},
+		        {"name", name + "_code"},
+		        {"output", {{"sha256", fake_hash(name + ".output")}}}};
+	}
+
+	nlohmann::json function_export(const std::string &prefix, size_t index)
+	{
+		return {{"export_symbol",
+		         "__export_" + prefix + "_" + mangled_entry(index)},
+		        {"exported", true},
+		        {"interrupt_status", "enabled"},
+		        {"kind", "Function"},
+		        {"register_arguments", 0},
+		        {"start_offset", 64 * index}};
+	}
+
+	nlohmann::json mmio_import(uint32_t start, bool writeable)
+	{
+		return {{"kind", "MMIO"},
+		        {"length", 4096},
+		        {"permits_load", true},
+		        {"permits_load_mutable", false},
+		        {"permits_load_store_capabilities", false},
+		        {"permits_store", writeable},
+		        {"start", start}};
+	}
+
+	nlohmann::json shared_object_import(const std::string &name,
+	                                    uint32_t           start,
+	                                    uint32_t           length,
+	                                    bool               writeable)
+	{
+		return {{"kind", "SharedObject"},
+		        {"length", length},
+		        {"permits_load", true},
+		        {"permits_load_mutable", writeable},
+		        {"permits_load_store_capabilities", true},
+		        {"permits_store", writeable},
+		        {"shared_object", name},
+		        {"start", start}};
+	}
+
+	nlohmann::json allocator_capability(uint32_t quota)
+	{
+		std::stringstream contents;
+		contents << std::hex;
+		for (int i = 0; i < 4; i++)
+		{
+			contents.width(2);
+			contents.fill('0');
+			contents << ((quota >> (i * 8)) & 0xff);
+		}
+		contents << " 00000000 00000000 00000000 00000000 00000000";
+		return {{"contents", contents.str()},
+		        {"kind", "SealedObject"},
+		        {"sealing_type",
+		         {{"compartment", "alloc"},
+		          {"key", "MallocKey"},
+		          {"provided_by", compartment_file("allocator")},
+		          {"symbol", "__export.sealing_type.alloc.MallocKey"}}}};
+	}
+} // namespace
+
+int main(int argc, char **argv)
+{
+	CLI::App    app{"Generate a synthetic CHERIoT firmware report"};
+	size_t      compartmentCount      = 100;
+	size_t      exportsPerCompartment = 8;
+	size_t      callsPerCompartment   = 16;
+	size_t      threadCount           = 8;
+	unsigned    seed                  = 42;
+	std::string reportFile;
+	std::string boardFile;
+	app.add_option("-c,--compartments", compartmentCount, "Compartments")
+	  ->check(CLI::PositiveNumber);
+	app
+	  .add_option(
+	    "-e,--exports", exportsPerCompartment, "Exports per compartment")
+	  ->check(CLI::PositiveNumber);
+	app.add_option(
+	  "-i,--imports", callsPerCompartment, "Call imports per compartment");
+	app.add_option("-t,--threads", threadCount, "Threads");
+	app.add_option("-s,--seed", seed, "Random seed");
+	app.add_option("-o,--report", reportFile, "Output firmware report")
+	  ->required();
+	app.add_option("-b,--board", boardFile, "Output board description")
+	  ->required();
+	CLI11_PARSE(app, argc, argv);
+
+	std::mt19937   rng(seed);
+	nlohmann::json compartments = nlohmann::json::object();
+
+	// The RTOS core compartments that the built-in rtos policy checks.
+	uint32_t hazardStart = SharedObjectBase;
+	uint32_t hazardSize  = threadCount * 2 * 8;
+	uint32_t epochStart  = hazardStart + hazardSize;
+	compartments["allocator"] = {
+	  {"code", code_section("allocator")},
+	  {"exports",
+	   {{{"export_symbol", "__export.sealing_type.alloc.MallocKey"},
+	     {"exported", true},
+	     {"kind", "SealingKey"}},
+	    function_export("alloc", 0),
+	    function_export("alloc", 1)}},
+	  {"imports",
+	   {shared_object_import(
+	      "allocator_hazard_pointers", hazardStart, hazardSize, false),
+	    shared_object_import("allocator_epoch", epochStart, 4, true),
+	    mmio_import(0x8f000000, true)}}};
+	compartments["scheduler"] = {
+	  {"code", code_section("scheduler")},
+	  {"exports", {function_export("sched", 0)}},
+	  {"imports",
+	   {mmio_import(0x2000000, true),
+	    mmio_import(0xc000000, true),
+	    shared_object_import("allocator_epoch", epochStart, 4, false)}}};
+
+	std::uniform_int_distribution<size_t> pickCompartment(
+	  0, compartmentCount - 1);
+	std::uniform_int_distribution<size_t> pickExport(
+	  0, exportsPerCompartment - 1);
+	std::uniform_int_distribution<int>    percent(0, 99);
+	for (size_t i = 0; i < compartmentCount; i++)
+	{
+		std::string    name    = "compartment" + std::to_string(i);
+		nlohmann::json exports = nlohmann::json::array();
+		for (size_t e = 0; e < exportsPerCompartment; e++)
+		{
+			exports.push_back(function_export(name, e));
+		}
+		nlohmann::json imports = nlohmann::json::array();
+		for (size_t c = 0; c < callsPerCompartment; c++)
+		{
+			std::string callee =
+			  "compartment" + std::to_string(pickCompartment(rng));
+			size_t entry = pickExport(rng);
+			imports.push_back(
+			  {{"compartment_name", callee},
+			   {"export_symbol",
+			    "__export_" + callee + "_" + mangled_entry(entry)},
+			   {"function", "entry" + std::to_string(entry) + "()"},
+			   {"kind", "CompartmentExport"},
+			   {"provided_by", compartment_file(callee)}});
+		}
+		imports.push_back(
+		  {{"export_symbol",
+		    "__export_alloc_" + mangled_entry(percent(rng) % 2)},
+		   {"function", "entry0()"},
+		   {"kind", "CompartmentExport"},
+		   {"provided_by", compartment_file("allocator")}});
+		if (percent(rng) < 50)
+		{
+			imports.push_back(allocator_capability(4096 * (1 + percent(rng))));
+		}
+		if (percent(rng) < 10)
+		{
+			imports.push_back(mmio_import(0x10000000, true));
+		}
+		compartments[name] = {{"code", code_section(name)},
+		                      {"exports", exports},
+		                      {"imports", imports}};
+	}
+
+	nlohmann::json threads = nlohmann::json::array();
+	for (size_t i = 0; i < threadCount; i++)
+	{
+		std::string entry =
+		  "compartment" + std::to_string(i % compartmentCount);
+		threads.push_back(
+		  {{"entry_point",
+		    {{"compartment_name", entry},
+		     {"function", "entry0()"},
+		     {"provided_by", compartment_file(entry)}}},
+		   {"priority", 1 + (i % 4)},
+		   {"stack", {{"length", 2048}, {"start", 0x80010000 + 2048 * i}}},
+		   {"trusted_stack",
+		    {{"length", 408}, {"start", 0x80008000 + 512 * i}}}});
+	}
+
+	nlohmann::json report = {
+	  {"compartments", compartments},
+	  {"core", nlohmann::json::object()},
+	  {"file", "build/synthetic"},
+	  {"final_hash", fake_hash("synthetic" + std::to_string(seed))},
+	  {"sharedObjects",
+	   {{{"end", hazardStart + hazardSize},
+	     {"name", "allocator_hazard_pointers"},
+	     {"start", hazardStart}},
+	    {{"end", epochStart + 4},
+	     {"name", "allocator_epoch"},
+	     {"start", epochStart}}}},
+	  {"threads", threads}};
+	std::ofstream(reportFile) << report.dump(1) << std::endl;
+
+	nlohmann::json devices = nlohmann::json::object();
+	for (auto &[name, start] : Devices)
+	{
+		devices[name] = {{"start", start}, {"length", 4096}};
+	}
+	nlohmann::json board = {
+	  {"devices", devices},
+	  {"heap", {{"start", 0x80100000}, {"end", 0x80200000}}},
+	  {"instruction_memory", {{"start", 0x80000000}, {"end", 0x80200000}}}};
+	std::ofstream(boardFile) << board.dump(1) << std::endl;
+}
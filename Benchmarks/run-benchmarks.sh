@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+# Time the built-in queries against synthetic firmware reports of increasing
+# size.
+#
+# Usage: run-benchmarks.sh <cheriot-audit> <generate-report> <work dir> [sizes...]
+#
+# Each size is a number of compartments.  The output is a table with one row
+# per size and query, giving the wall-clock time in seconds for a complete
+# cheriot-audit run (including loading the report).  For each size, the time
+# to load the report and evaluate a trivial query is also given for the JSON
+# report and for a snapshot of it.  A second table gives the peak memory use
+# for a query that needs only the threads, with the whole report loaded and
+# with --input-sections threads.
+set -e
+
+AUDIT=$1
+GENERATE=$2
+WORKDIR=$3
+shift 3
+SIZES=${*:-"50 200 1000"}
+
+QUERIES=(
+	'data.compartment.compartments_calling("compartment0")'
+	'data.compartment.mmio_allow_list("uart", {"compartment0"})'
+	'data.rtos.valid'
+	'sum([ data.rtos.decode_allocator_capability(c).quota | c = input.compartments[_].imports[_] ; data.rtos.is_allocator_capability(c) ])'
+)
+
+mkdir -p "$WORKDIR"
+TIMEFORMAT=%R
+printf "%-12s %-10s %s\n" "compartments" "seconds" "query"
+for SIZE in $SIZES
+do
+	REPORT="$WORKDIR/report-$SIZE.json"
+	BOARD="$WORKDIR/board-$SIZE.json"
+	"$GENERATE" --compartments "$SIZE" --report "$REPORT" --board "$BOARD"
+	for QUERY in "${QUERIES[@]}"
+	do
+		SECONDS_TAKEN=$( { time "$AUDIT" -b "$BOARD" -j "$REPORT" -q "$QUERY" > /dev/null ; } 2>&1 )
+		printf "%-12s %-10s %s\n" "$SIZE" "$SECONDS_TAKEN" "$QUERY"
+	done
+	SNAPSHOT="$WORKDIR/report-$SIZE.snapshot"
+	"$AUDIT" -b "$BOARD" -j "$REPORT" --write-snapshot "$SNAPSHOT"
+	for INPUT in "$REPORT" "$SNAPSHOT"
+	do
+		SECONDS_TAKEN=$( { time "$AUDIT" -b "$BOARD" -j "$INPUT" -q 'true' > /dev/null ; } 2>&1 )
+		printf "%-12s %-10s %s\n" "$SIZE" "$SECONDS_TAKEN" "load ${INPUT##*.}"
+	done
+done
+printf "\n%-12s %-12s %s\n" "compartments" "peak bytes" "sections"
+for SIZE in $SIZES
+do
+	REPORT="$WORKDIR/report-$SIZE.json"
+	BOARD="$WORKDIR/board-$SIZE.json"
+	PROFILE="$WORKDIR/profile-$SIZE.json"
+	for SECTIONS in "" "threads"
+	do
+		"$AUDIT" -b "$BOARD" -j "$REPORT" ${SECTIONS:+--input-sections "$SECTIONS"} -q 'count(input.threads)' --profile "$PROFILE" > /dev/null
+		PEAK=$(sed -n 's/.*"peak_memory_bytes": *\([0-9]*\).*/\1/p' "$PROFILE")
+		printf "%-12s %-12s %s\n" "$SIZE" "$PEAK" "${SECTIONS:-all}"
+	done
+done
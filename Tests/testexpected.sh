@@ -1,4 +1,6 @@
 #!/bin/sh
 set -e
 cd "$(dirname $(readlink -f -- "$0"))"
+# Tests that run the tool more than once refer to it as $CHERIOT_AUDIT.
+export CHERIOT_AUDIT="$1"
 /bin/sh -c "$1 $(grep -v '^#' $2)" | diff - $2.expected
@@ -0,0 +1,66 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+// Checks the decisions that watch mode makes about what to reload when its
+// inputs change.
+
+#include <cstdlib>
+#include <iostream>
+
+#include "../watch.hh"
+
+namespace
+{
+	const std::filesystem::path              Board  = "board.json";
+	const std::filesystem::path              Report = "firmware.json";
+	const std::filesystem::path              Query  = "queries.json";
+	const std::vector<std::filesystem::path> Modules{"a.rego", "b.rego"};
+
+	int failures = 0;
+
+	/**
+	 * Check the reload decision when `changed` have changed.
+	 */
+	void check(const char                                  *name,
+	           std::initializer_list<std::filesystem::path> changed,
+	           WatchReload                                  expected,
+	           bool                                         haveContext = true,
+	           bool                                         haveImage   = true)
+	{
+		std::set<std::filesystem::path> normalised;
+		for (auto &file : changed)
+		{
+			normalised.insert(FileWatcher::normalise(file));
+		}
+		auto reload = watch_reload(
+		  normalised, Board, Modules, Report, Query, haveContext, haveImage);
+		if ((reload.board != expected.board) ||
+		    (reload.modules != expected.modules) ||
+		    (reload.report != expected.report) ||
+		    (reload.interpreter != expected.interpreter) ||
+		    (reload.queries != expected.queries))
+		{
+			std::cerr << "FAIL: " << name << std::endl;
+			failures++;
+		}
+	}
+} // namespace
+
+int main()
+{
+	// Fields are board, modules, report, interpreter, queries.
+	check("query file", {Query}, {false, false, false, false, true});
+	check("module", {Modules[1]}, {false, true, false, true, false});
+	check("report", {Report}, {false, false, true, true, false});
+	check("board", {Board}, {true, false, true, true, false});
+	check("module and query file",
+	      {Modules[0], Query},
+	      {false, true, false, true, true});
+	check(
+	  "unrelated file", {"other.json"}, {false, false, false, false, false});
+	check(
+	  "failed context", {Query}, {true, true, true, true, true}, false, false);
+	check(
+	  "failed report", {Query}, {false, false, true, true, true}, true, false);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -2,86 +2,76 @@
 // SPDX-License-Identifier: MIT
 
 #include <CLI/CLI.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <charconv>
-#include <cxxabi.h>
+#include <chrono>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <list>
+#include <map>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <optional>
 #include <rego/rego.hh>
+#include <set>
+#include <span>
 #include <sstream>
 #include <string>
+#include <thread>
 
+#include "board.hh"
+#include "cache.hh"
+#include "callgraph.hh"
 #include "compartment.hh"
+#include "demangle.hh"
+#include "devices.hh"
+#include "hex.hh"
+#include "incremental.hh"
+#include "index.hh"
+#include "layout.hh"
+#include "profile.hh"
+#include "regex.hh"
+#include "resources.hh"
+#include "snapshot.hh"
 #include "rtos.hh"
+#include "rtos_policy.hh"
+#include "term.hh"
+#include "verify.hh"
+#include "watch.hh"
 
 namespace
 {
+	using namespace rego;
+	namespace bi = rego::builtins;
+
 	/**
-	 * Add the board JSON to a Rego interpreter.  The board files are *almost*
-	 * JSON, with the exception that they use 0x for hex numbers.  This
-	 * function will try parsing the board description and rewrite the hex
-	 * numbers to decimal when it encounters them.
+	 * Returns the value of a node that has been unwrapped to a JSONString.
+	 * This is equivalent to `get_string`, but returns a view of the node's
+	 * source rather than a copy and so does not allocate.  The source is
+	 * still escaped, so if it contains any escape sequences this falls back
+	 * to `get_string`, stores the result in `storage`, and returns a view of
+	 * that.  The view is valid for as long as both the node and `storage`
+	 * are.
 	 */
-	bool add_board_json(rego::Interpreter &rego, const std::string &filename)
+	std::string_view get_string_view(const Node &node, std::string &storage)
 	{
-		nlohmann::json j;
-		std::ifstream  ifs(filename);
-		std::string    value(std::istreambuf_iterator<char>{ifs}, {});
-		while (j.empty())
+		auto view = node->location().view();
+		if (view.find('\\') != std::string_view::npos)
 		{
-			try
-			{
-				j = j.parse(value);
-				break;
-			}
-			catch (nlohmann::json::parse_error &e)
-			{
-				if (e.byte < 2)
-				{
-					return false;
-				}
-				if (value.substr(e.byte - 2, 2) != "0x")
-				{
-					return false;
-				}
-				uint32_t    result;
-				const char *start = value.c_str() + e.byte;
-				auto [end, error] = std::from_chars(
-				  start, value.c_str() + value.size(), result, 16);
-				if (error != std::errc{})
-				{
-					return false;
-				}
-				std::stringstream ss;
-				ss.setf(std::ios::dec);
-				ss << result;
-				start -= 2;
-				value.replace(start - value.c_str(), end - start, ss.str());
-				start = value.c_str() + (e.byte - 2);
-			}
+			storage = get_string(node);
+			return storage;
 		}
-		// Now that we've parsed the JSON, normalise it slightly.  Devices can
-		// be expressed as start and end or start and length.  In the linker
-		// report, they're always start and length, so we'll convert any end to
-		// a length.
-		for (auto &device : j["devices"])
+		if ((view.size() >= 2) && view.starts_with('"') && view.ends_with('"'))
 		{
-			if (device.contains("end"))
-			{
-				device["length"] = device["end"].get<uint32_t>() -
-				                   device["start"].get<uint32_t>();
-				device.erase("end");
-			}
+			view = view.substr(1, view.size() - 2);
 		}
-		std::stringstream ss;
-		ss << "{ \"board\": " << j.dump() << "}";
-		rego.add_data_json(ss.str());
-		return true;
+		return view;
 	}
 
-	using namespace rego;
-	namespace bi = rego::builtins;
-
 	Node demangle_export_decl =
 	  bi::Decl << (bi::ArgSeq
 	               << (bi::Arg << (bi::Name ^ "exportName")
@@ -110,86 +100,386 @@ namespace
 		{
 			return Undefined;
 		}
-		auto string                = get_string(exportName);
-		auto compartmentNameString = get_string(compartmentName);
-		const std::string_view LibraryExportPrefix =
-		  "__library_export_libcalls";
-		const std::string_view ExportPrefix = "__export_";
-		if (string.starts_with(LibraryExportPrefix))
+		std::string exportNameStorage;
+		std::string compartmentNameStorage;
+		auto        demangled = demangledNames.get(
+		  get_string_view(exportName, exportNameStorage),
+		  get_string_view(compartmentName, compartmentNameStorage));
+		if (!demangled)
 		{
-			string = string.substr(LibraryExportPrefix.size());
+			return Undefined;
 		}
-		else
+		return scalar(std::string(*demangled));
+	}
+
+	Node demangle_export_table_decl =
+	  bi::Decl << (bi::ArgSeq
+	               << (bi::Arg << (bi::Name ^ "compartmentName")
+	                           << bi::Description << (bi::Type << bi::String))
+	               << (bi::Arg << (bi::Name ^ "exportNames")
+	                           << (bi::Description ^ "mangled symbol names")
+	                           << (bi::Type << bi::Any)))
+	           << (bi::Result << (bi::Name ^ "demangled")
+	                          << (bi::Description ^
+	                              "object mapping symbols to demangled names")
+	                          << (bi::Type << bi::Any));
+
+	/**
+	 * Built-in function exposed to Rego for demangling all of the exports of
+	 * a compartment in one call.  Takes two arguments, the compartment name
+	 * and an array of mangled symbol names, and returns an object mapping
+	 * each symbol that can be demangled to its demangled name.
+	 */
+	Node demangle_export_table(const Nodes &args)
+	{
+		Node compartmentName =
+		  unwrap_arg(args, UnwrapOpt(0).types({JSONString}));
+		Node exportNames = unwrap_arg(args, UnwrapOpt(1).types({Array}));
+		if ((compartmentName->type() == Error) ||
+		    (exportNames->type() == Error))
 		{
-			if (!string.starts_with(ExportPrefix))
+			return Undefined;
+		}
+		std::string compartmentNameStorage;
+		std::string symbolStorage;
+		auto        compartmentNameString =
+		  get_string_view(compartmentName, compartmentNameStorage);
+		Nodes entries;
+		for (auto &element : *exportNames)
+		{
+			auto [symbolNode, isString] = unwrap(element, JSONString);
+			if (!isString)
 			{
-				return Undefined;
+				continue;
 			}
-			string = string.substr(ExportPrefix.size());
-			if (!string.starts_with(compartmentNameString))
+			auto symbol = get_string_view(symbolNode, symbolStorage);
+			if (auto demangled =
+			      demangledNames.get(symbol, compartmentNameString))
 			{
-				return Undefined;
+				entries.push_back(object_item(scalar(std::string(symbol)),
+				                              scalar(std::string(*demangled))));
+			}
+		}
+		return object(entries);
+	}
+
+	Node match_export_table_decl =
+	  bi::Decl << (bi::ArgSeq
+	               << (bi::Arg << (bi::Name ^ "pattern")
+	                           << (bi::Description ^
+	                               "regular expression to match")
+	                           << (bi::Type << bi::String))
+	               << (bi::Arg << (bi::Name ^ "table")
+	                           << (bi::Description ^
+	                               "demangled export names, by compartment")
+	                           << (bi::Type << bi::Any)))
+	           << (bi::Result << (bi::Name ^ "matches")
+	                          << (bi::Description ^
+	                              "compartment and export symbol pairs")
+	                          << (bi::Type << bi::Any));
+
+	/**
+	 * Built-in function exposed to Rego for matching a regular expression
+	 * against demangled export names.  Takes two arguments, the pattern and
+	 * an object in the same format as `data.demangled`, mapping compartment
+	 * names to objects that map export symbols to demangled names.  Returns
+	 * an array of `{ "compartment": name, "export_symbol": symbol }` objects
+	 * for every export whose demangled name matches.  Patterns are compiled
+	 * once and cached.
+	 */
+	Node match_export_table(const Nodes &args)
+	{
+		Node patternNode = unwrap_arg(args, UnwrapOpt(0).types({JSONString}));
+		Node table       = unwrap_arg(args, UnwrapOpt(1).types({Object}));
+		if ((patternNode->type() == Error) || (table->type() == Error))
+		{
+			return Undefined;
+		}
+		std::string patternStorage;
+		std::string demangledStorage;
+		auto        pattern =
+		  compiledPatterns.get(get_string_view(patternNode, patternStorage));
+		if (!pattern)
+		{
+			return err(patternNode, "Invalid regular expression");
+		}
+		Nodes matches;
+		for (auto &compartment : *table)
+		{
+			auto [nameNode, nameIsString] =
+			  unwrap(compartment->front(), JSONString);
+			auto [exports, isObject] = unwrap(compartment->back(), Object);
+			if (!nameIsString || !isObject)
+			{
+				continue;
+			}
+			auto name = get_string(nameNode);
+			for (auto &entry : *exports)
+			{
+				auto [symbol, symbolIsString] =
+				  unwrap(entry->front(), JSONString);
+				auto [demangled, demangledIsString] =
+				  unwrap(entry->back(), JSONString);
+				if (!symbolIsString || !demangledIsString)
+				{
+					continue;
+				}
+				auto demangledName =
+				  get_string_view(demangled, demangledStorage);
+				if (!RE2::PartialMatch(demangledName, *pattern))
+				{
+					continue;
+				}
+				matches.push_back(object(
+				  {object_item(scalar("compartment"), scalar(name)),
+				   object_item(scalar("export_symbol"),
+				               scalar(get_string(symbol)))}));
 			}
-			string = string.substr(compartmentNameString.size());
 		}
-		if (!string.starts_with("_"))
+		return array(matches);
+	}
+
+	Node callgraph_reachable_decl =
+	  bi::Decl << (bi::ArgSeq
+	               << (bi::Arg << (bi::Name ^ "from")
+	                           << (bi::Description ^
+	                               "compartment or library name")
+	                           << (bi::Type << bi::String)))
+	           << (bi::Result << (bi::Name ^ "reachable")
+	                          << (bi::Description ^
+	                              "compartments and libraries reachable")
+	                          << (bi::Type << bi::Any));
+
+	/**
+	 * Built-in function exposed to Rego for finding everything that can be
+	 * reached from a compartment or library by following one or more calls.
+	 * Returns a sorted array of names, which includes the starting point only
+	 * if it is part of a cycle.  Evaluates to undefined if the name is not in
+	 * the firmware image.
+	 */
+	Node callgraph_reachable(const CallGraph &callGraph, const Nodes &args)
+	{
+		Node from = unwrap_arg(args, UnwrapOpt(0).types({JSONString}));
+		if (from->type() == Error)
+		{
+			return Undefined;
+		}
+		auto node = callGraph.find(get_string(from));
+		if (!node)
+		{
+			return Undefined;
+		}
+		Nodes names;
+		for (auto &name : callGraph.reachable(*node))
+		{
+			names.push_back(scalar(name));
+		}
+		return array(names);
+	}
+
+	Node callgraph_path_decl =
+	  bi::Decl << (bi::ArgSeq
+	               << (bi::Arg << (bi::Name ^ "from")
+	                           << (bi::Description ^ "caller name")
+	                           << (bi::Type << bi::String))
+	               << (bi::Arg << (bi::Name ^ "to")
+	                           << (bi::Description ^ "callee name")
+	                           << (bi::Type << bi::String)))
+	           << (bi::Result << (bi::Name ^ "path")
+	                          << (bi::Description ^ "shortest call path")
+	                          << (bi::Type << bi::Any));
+
+	/**
+	 * Built-in function exposed to Rego for finding a shortest chain of calls
+	 * from one compartment or library to another.  Returns an array of names
+	 * starting with `from` and ending with `to`, or undefined if there is no
+	 * such path.
+	 */
+	Node callgraph_path(const CallGraph &callGraph, const Nodes &args)
+	{
+		Node from = unwrap_arg(args, UnwrapOpt(0).types({JSONString}));
+		Node to   = unwrap_arg(args, UnwrapOpt(1).types({JSONString}));
+		if ((from->type() == Error) || (to->type() == Error))
+		{
+			return Undefined;
+		}
+		auto fromNode = callGraph.find(get_string(from));
+		auto toNode   = callGraph.find(get_string(to));
+		if (!fromNode || !toNode)
+		{
+			return Undefined;
+		}
+		auto path = callGraph.path(*fromNode, *toNode);
+		if (!path)
+		{
+			return Undefined;
+		}
+		Nodes names;
+		for (auto &name : *path)
+		{
+			names.push_back(scalar(name));
+		}
+		return array(names);
+	}
+
+	/**
+	 * Helper that reads a non-negative integer argument as a 64-bit address
+	 * or length.  Returns an empty optional if the argument is not a valid
+	 * integer in range.
+	 */
+	std::optional<uint64_t> unwrap_uint64(const Nodes &args, size_t index)
+	{
+		Node node = unwrap_arg(args, UnwrapOpt(index).types({Int}));
+		if (node->type() == Error)
+		{
+			return std::nullopt;
+		}
+		auto value = get_int(node).to_int();
+		if (!value || (*value < 0))
+		{
+			return std::nullopt;
+		}
+		return uint64_t(*value);
+	}
+
+	Node mmio_device_at_decl =
+	  bi::Decl << (bi::ArgSeq
+	               << (bi::Arg << (bi::Name ^ "address")
+	                           << (bi::Description ^ "address to look up")
+	                           << (bi::Type << bi::Number)))
+	           << (bi::Result << (bi::Name ^ "device")
+	                          << (bi::Description ^ "device name")
+	                          << (bi::Type << bi::String));
+
+	/**
+	 * Built-in function exposed to Rego for finding the board device that
+	 * contains an address.  Evaluates to undefined if no device does.
+	 */
+	Node mmio_device_at(const DeviceIndex &devices, const Nodes &args)
+	{
+		auto address = unwrap_uint64(args, 0);
+		if (!address)
+		{
+			return Undefined;
+		}
+		auto device = devices.device_at(*address);
+		if (!device)
+		{
+			return Undefined;
+		}
+		return scalar(*device);
+	}
+
+	Node mmio_range_decl =
+	  bi::Decl << (bi::ArgSeq
+	               << (bi::Arg << (bi::Name ^ "start")
+	                           << (bi::Description ^ "start address")
+	                           << (bi::Type << bi::Number))
+	               << (bi::Arg << (bi::Name ^ "length")
+	                           << (bi::Description ^ "length in bytes")
+	                           << (bi::Type << bi::Number)))
+	           << (bi::Result << (bi::Name ^ "names")
+	                          << (bi::Description ^ "sorted array of names")
+	                          << (bi::Type << bi::Any));
+
+	/**
+	 * Built-in function exposed to Rego for finding the board devices that
+	 * overlap a range of addresses, given as a start and a length.  Returns
+	 * an array of device names in order of their start addresses.
+	 */
+	Node mmio_devices_overlapping(const DeviceIndex &devices, const Nodes &args)
+	{
+		auto start  = unwrap_uint64(args, 0);
+		auto length = unwrap_uint64(args, 1);
+		if (!start || !length)
 		{
 			return Undefined;
 		}
-		string = string.substr(1);
-		// The way that rego-cpp exposes snmalloc can cause the realloc here to
-		// crash.  Try to allocate a buffer that's large enough that we don't
-		// care.
-		size_t bufferSize = strlen(string.c_str()) * 8;
-		char  *buffer     = static_cast<char *>(malloc(bufferSize));
-		int    error;
-		buffer =
-		  abi::__cxa_demangle(string.c_str(), buffer, &bufferSize, &error);
-		if (error != 0)
-		{
-			free(buffer);
+		Nodes names;
+		for (auto &device : devices.overlapping(*start, *length))
+		{
+			names.push_back(scalar(device.name));
+		}
+		return array(names);
+	}
+
+	/**
+	 * Built-in function exposed to Rego for finding the compartments that
+	 * import exactly a range of addresses as MMIO, given as a start and a
+	 * length.  Returns a sorted array of compartment names.
+	 */
+	Node mmio_importers(const DeviceIndex &devices, const Nodes &args)
+	{
+		auto start  = unwrap_uint64(args, 0);
+		auto length = unwrap_uint64(args, 1);
+		if (!start || !length)
+		{
 			return Undefined;
 		}
-		std::string demangled(buffer);
-		free(buffer);
-		return scalar(std::move(demangled));
+		Nodes names;
+		for (auto &name : devices.importers_of(*start, *length))
+		{
+			names.push_back(scalar(name));
+		}
+		return array(names);
+	}
+
+	Node rtos_policy_decl =
+	  bi::Decl << bi::ArgSeq
+	           << (bi::Result << (bi::Name ^ "verdict")
+	                          << (bi::Description ^
+	                              "object with valid and violations")
+	                          << (bi::Type << bi::Any));
+
+	/**
+	 * Built-in function exposed to Rego for the native implementation of
+	 * `data.rtos.valid`.  The verdict is computed when the firmware report
+	 * is loaded.  Returns an object with `valid`, a boolean, and
+	 * `violations`, an array of the names of the clauses that do not hold.
+	 */
+	Node rtos_policy(const RTOSPolicyVerdict &verdict, const Nodes &)
+	{
+		Nodes violations;
+		for (auto &clause : verdict.violations)
+		{
+			violations.push_back(scalar(clause));
+		}
+		return object(
+		  {object_item(scalar("valid"), scalar(verdict.valid)),
+		   object_item(scalar("violations"), array(violations))});
 	}
 
 	/**
-	 * Helper that decodes the hex strings emitted for static sealed objects.
-	 * These are written as sequences of bytes, with a space between each four
-	 * bytes.
+	 * Helper that returns the bytes of the hex strings emitted for static
+	 * sealed objects.  These are decoded when the firmware report is loaded,
+	 * so this is usually a lookup in the image's `sealedObjects` that does
+	 * not allocate.  Strings that are not in the cache are decoded into a
+	 * buffer that is reused by every call on the same thread, so the result
+	 * is valid only until the next call.
 	 *
 	 * Takes a node that must have been unwrapped to a JSONString.
 	 */
-	std::vector<uint8_t> decode_hex_node(const Node &node)
+	std::span<const uint8_t>
+	hex_node_bytes(const SealedObjectContents &sealedObjects, const Node &node)
 	{
+		thread_local std::vector<uint8_t> scratch;
+		thread_local std::string          storage;
 		if (node->type() == Error)
 		{
 			return {};
 		}
-		auto                 hexString = get_string(node);
-		std::vector<uint8_t> result;
-		while (hexString.size() >= 8)
-		{
-			for (size_t i = 0; i < 8; i += 2)
-			{
-				uint8_t byte;
-				auto [p, ec] = std::from_chars(
-				  hexString.data() + i, hexString.data() + i + 2, byte, 16);
-				if (ec != std::errc{})
-				{
-					return {};
-				}
-				result.push_back(byte);
-			}
-			hexString = hexString.substr(8);
-			if (hexString.size() > 0 && hexString[0] == ' ')
-			{
-				hexString = hexString.substr(1);
-			}
-		}
-		return result;
+		return sealedObjects.get(get_string_view(node, storage), scratch);
+	}
+
+	/**
+	 * Returns the C string at the start of `bytes`, which ends at the first
+	 * null byte or at the end of `bytes`.  The string is copied once, at its
+	 * final size.
+	 */
+	std::string c_string_from_bytes(std::span<const uint8_t> bytes)
+	{
+		return std::string(bytes.begin(),
+		                   std::find(bytes.begin(), bytes.end(), '\0'));
 	}
 
 	Node decode_integer_decl =
@@ -222,10 +512,11 @@ namespace
 	 * but it's easier to allow it than exclude it).  This corresponds to
 	 * uint8_t, uint16_t, and uint32_t in the source.
 	 */
-	Node decode_integer(const Nodes &args)
+	Node decode_integer(const SealedObjectContents &sealedObjects,
+	                    const Nodes                &args)
 	{
-		auto bytes =
-		  decode_hex_node(unwrap_arg(args, UnwrapOpt(0).types({JSONString})));
+		auto bytes = hex_node_bytes(
+		  sealedObjects, unwrap_arg(args, UnwrapOpt(0).types({JSONString})));
 		auto offsetNode = unwrap_arg(args, UnwrapOpt(1).types({Int}));
 		auto lengthNode = unwrap_arg(args, UnwrapOpt(2).types({Int}));
 		if ((offsetNode->type() == Error) || (lengthNode->type() == Error))
@@ -277,11 +568,12 @@ namespace
 	 * C string into a Rego string.  This takes two arguments, the hex string
 	 * and the offset where the C string starts.
 	 */
-	Node decode_c_string(const Nodes &args)
+	Node decode_c_string(const SealedObjectContents &sealedObjects,
+	                     const Nodes                &args)
 	{
-		auto bytes =
-		  decode_hex_node(unwrap_arg(args, UnwrapOpt(0).types({JSONString})));
-		auto        offsetNode = unwrap_arg(args, UnwrapOpt(1).types({Int}));
+		auto bytes = hex_node_bytes(
+		  sealedObjects, unwrap_arg(args, UnwrapOpt(0).types({JSONString})));
+		auto offsetNode = unwrap_arg(args, UnwrapOpt(1).types({Int}));
 
 		auto maybeOffset = get_int(offsetNode).to_size();
 		if (!maybeOffset.has_value())
@@ -290,18 +582,82 @@ namespace
 		}
 		size_t offset = maybeOffset.value();
 
-		std::string result;
 		if (offset >= bytes.size())
 		{
 			return Undefined;
 		}
-		for (auto it = bytes.begin() + offset;
-		     (it != bytes.end()) && (*it != '\0');
-		     it++)
+		return scalar(c_string_from_bytes(bytes.subspan(offset)));
+	}
+
+	Node decode_sealed_object_decl =
+	  bi::Decl << (bi::ArgSeq
+	               << (bi::Arg << (bi::Name ^ "hex")
+	                           << (bi::Description ^ "The hex string to decode")
+	                           << (bi::Type << bi::String))
+	               << (bi::Arg << (bi::Name ^ "layout")
+	                           << (bi::Description ^
+	                               "Descriptor of the fields in the object")
+	                           << (bi::Type << bi::String)))
+	           << (bi::Result << (bi::Name ^ "result")
+	                          << (bi::Description ^ "Decoded object")
+	                          << (bi::Type << bi::Any));
+
+	/**
+	 * Built-in function exposed to Rego for decoding a whole static sealed
+	 * object in one call.  This takes two arguments, the hex string and a
+	 * layout descriptor (see `compile_sealed_object_layout`), and returns an
+	 * object with one entry per field.  Evaluates to an error if the layout
+	 * is not valid and to undefined if it does not fit in the object.
+	 */
+	Node decode_sealed_object(const SealedObjectContents &sealedObjects,
+	                          const Nodes                &args)
+	{
+		auto bytes = hex_node_bytes(
+		  sealedObjects, unwrap_arg(args, UnwrapOpt(0).types({JSONString})));
+		auto layoutNode = unwrap_arg(args, UnwrapOpt(1).types({JSONString}));
+		if (layoutNode->type() == Error)
+		{
+			return Undefined;
+		}
+		auto layout = sealedObjectLayouts.get(get_string(layoutNode));
+		if (!layout)
+		{
+			return err(layoutNode, "Invalid sealed object layout");
+		}
+		Nodes fields;
+		for (auto &field : *layout)
 		{
-			result.push_back(*it);
+			if (field.offset + field.size() > bytes.size())
+			{
+				return Undefined;
+			}
+			Node value;
+			if (field.isString)
+			{
+				value = scalar(c_string_from_bytes(
+				  bytes.subspan(field.offset, field.size())));
+			}
+			else if (field.count > 0)
+			{
+				Nodes elements;
+				for (size_t i = 0; i < field.count; i++)
+				{
+					elements.push_back(scalar(
+					  BigInt{read_layout_integer(bytes,
+					                             field.offset + i * field.width,
+					                             field.width,
+					                             field.isSigned)}));
+				}
+				value = array(elements);
+			}
+			else
+			{
+				value = scalar(BigInt{read_layout_integer(
+				  bytes, field.offset, field.width, field.isSigned)});
+			}
+			fields.push_back(object_item(scalar(field.name), value));
 		}
-		return scalar(std::move(result));
+		return object(fields);
 	}
 
 	std::string
@@ -371,56 +727,1687 @@ namespace
 
 		return expressions[0].dump();
 	}
-} // namespace
 
-int main(int argc, char **argv)
-{
-	CLI::App                           app{"Audit a CHERIoT firmware image"};
-	std::string                        boardJSONFile;
-	std::string                        firmwareReportJSONFile;
-	std::vector<std::filesystem::path> modules;
-	std::string                        query;
-	app.add_option("-b,--board", boardJSONFile, "Board JSON file")
-	  ->required()
-	  ->check(CLI::ExistingFile);
-	app
-	  .add_option("-m,--module",
-	              modules,
-	              "Modules to load.  This option may be passed more than once.")
-	  ->check(CLI::ExistingFile);
-	app.add_option("-q,--query", query, "The query to run.")->required();
-	app
-	  .add_option("-j,--firmware-report",
-	              firmwareReportJSONFile,
-	              "Firmware report JSON file generated by the linker.")
-	  ->required()
-	  ->check(CLI::ExistingFile);
-	CLI11_PARSE(app, argc, argv);
-	rego::Interpreter rego;
-	rego.builtins()->register_builtin(
-	  BuiltInDef::create(Location("export_entry_demangle"),
-	                     demangle_export_decl,
-	                     demangle_export));
-	rego.builtins()->register_builtin(
-	  BuiltInDef::create(Location("integer_from_hex_string"),
-	                     decode_integer_decl,
-	                     decode_integer));
-	rego.builtins()->register_builtin(
-	  BuiltInDef::create(Location("string_from_hex_string"),
-	                     decode_c_string_decl,
-	                     decode_c_string));
-	rego.set_input_json_file(firmwareReportJSONFile);
-	if (!add_board_json(rego, boardJSONFile))
-	{
-		std::cerr << "Failed to parse board JSON" << std::endl;
-		return EXIT_FAILURE;
+	/**
+	 * The formats in which the result of a single query can be written.
+	 */
+	enum class OutputFormat
+	{
+		/// The first expression of the first result, as JSON.
+		First,
+		/// The full result set, exactly as returned by the interpreter.
+		JSON,
+		/**
+		 * The first expression of each result, as JSON Lines.  Arrays are
+		 * written with one element per line.
+		 */
+		JSONLines,
+		/// The full result set, encoded as CBOR.
+		CBOR,
+	};
+
+	/**
+	 * Write the result of a query in the given format.  Undefined results
+	 * are written as `undefined` in the `First` and `JSON` formats and
+	 * produce no output in the others.
+	 *
+	 * The interpreter returns the result as JSON text, which the `JSON`
+	 * format writes unchanged.  The `JSONLines` and `CBOR` formats must
+	 * parse the whole result before writing it, so they need memory
+	 * proportional to the size of the result.
+	 */
+	void write_query_result(std::ostream      &out,
+	                        const std::string &resultJSON,
+	                        OutputFormat       format)
+	{
+		switch (format)
+		{
+			case OutputFormat::First:
+				out << extract_first_expression_from_result(resultJSON)
+				    << std::endl;
+				return;
+			case OutputFormat::JSON:
+				out << resultJSON << std::endl;
+				return;
+			default:
+				break;
+		}
+		if (resultJSON == "undefined")
+		{
+			return;
+		}
+		auto result =
+		  nlohmann::json::parse(resultJSON, nullptr, /*allow_exceptions*/ false);
+		if (result.is_discarded())
+		{
+			std::cerr << "error: query result is not valid JSON" << std::endl;
+			return;
+		}
+		if (format == OutputFormat::CBOR)
+		{
+			auto bytes = nlohmann::json::to_cbor(result);
+			out.write(reinterpret_cast<const char *>(bytes.data()),
+			          bytes.size());
+			out.flush();
+			return;
+		}
+		if (!result.is_array())
+		{
+			result = nlohmann::json::array({std::move(result)});
+		}
+		for (auto &entry : result)
+		{
+			if (!entry.contains("expressions") ||
+			    !entry["expressions"].is_array() ||
+			    entry["expressions"].empty())
+			{
+				continue;
+			}
+			auto &value = entry["expressions"][0];
+			if (!value.is_array())
+			{
+				out << value.dump() << '\n';
+				continue;
+			}
+			for (auto &element : value)
+			{
+				out << element.dump() << '\n';
+			}
+		}
+		out.flush();
 	}
-	rego.add_module("compartment", compartmentPackage);
-	rego.add_module("rtos", rtosPackage);
-	for (auto &modulePath : modules)
+
+	/**
+	 * The sections of the firmware report that each query in a query file
+	 * depends on, for incremental audits.  Queries that do not declare their
+	 * dependencies are not present.
+	 */
+	using QueryDependencies = std::map<std::string, std::vector<std::string>>;
+
+	/**
+	 * Read a batch query file.  This is a JSON object whose keys are the
+	 * names of queries and whose values are either the query strings or
+	 * objects with the query string in a `query` field and, optionally, an
+	 * array of the sections of the report that it depends on in a `depends`
+	 * field.  Queries are returned in the order that they appear in the
+	 * file.
+	 */
+	bool read_query_file(
+	  const std::string                                &filename,
+	  std::vector<std::pair<std::string, std::string>> &queries,
+	  QueryDependencies                                *dependencies = nullptr)
 	{
-		rego.add_module_file(modulePath);
+		nlohmann::ordered_json j;
+		std::ifstream          ifs(filename);
+		try
+		{
+			j = nlohmann::ordered_json::parse(ifs);
+		}
+		catch (nlohmann::json::parse_error &e)
+		{
+			std::cerr << e.what() << std::endl;
+			return false;
+		}
+		if (!j.is_object())
+		{
+			std::cerr << "error: query file must contain a JSON object"
+			          << std::endl;
+			return false;
+		}
+		for (auto &[name, value] : j.items())
+		{
+			if (value.is_string())
+			{
+				queries.emplace_back(name, value.get<std::string>());
+				continue;
+			}
+			if (!value.is_object() || !value.contains("query") ||
+			    !value["query"].is_string())
+			{
+				std::cerr << "error: query '" << name
+				          << "' is not a string or an object with a query"
+				          << std::endl;
+				return false;
+			}
+			queries.emplace_back(name, value["query"].get<std::string>());
+			if (value.contains("depends"))
+			{
+				auto &depends = value["depends"];
+				if (!depends.is_array() ||
+				    !std::all_of(depends.begin(),
+				                 depends.end(),
+				                 [](auto &d) { return d.is_string(); }))
+				{
+					std::cerr << "error: dependencies of query '" << name
+					          << "' are not an array of strings" << std::endl;
+					return false;
+				}
+				if (dependencies != nullptr)
+				{
+					(*dependencies)[name] =
+					  depends.get<std::vector<std::string>>();
+				}
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Add the result of a query to a JSON object that is being used as a
+	 * response.  The `result` field is omitted if the query is undefined and
+	 * an `error` field is provided instead if the result is not valid JSON.
+	 */
+	void add_result(nlohmann::ordered_json &response,
+	                const std::string      &expression)
+	{
+		if (expression != "undefined")
+		{
+			try
+			{
+				response["result"] = nlohmann::json::parse(expression);
+			}
+			catch (nlohmann::json::parse_error &)
+			{
+				response["error"] = expression;
+			}
+		}
+	}
+
+	/**
+	 * Format the result of one query in batch mode as a single line of JSON.
+	 */
+	std::string batch_result(const std::string &name,
+	                         const std::string &expression)
+	{
+		nlohmann::ordered_json line;
+		line["name"] = name;
+		add_result(line, expression);
+		return line.dump();
+	}
+
+	/**
+	 * Wrapper for built-in functions that records the number of calls and the
+	 * time spent in `builtinProfile<Fn>` when profiling is enabled.  The
+	 * arguments are forwarded to `Fn`.
+	 */
+	template<auto Fn, typename... Args>
+	Node profiled_builtin(const Args &...args)
+	{
+		if (!profiler.enabled)
+		{
+			return Fn(args...);
+		}
+		auto    &profile          = builtinProfile<Fn>;
+		uint64_t startAllocations = allocationCount;
+		auto     start            = std::chrono::steady_clock::now();
+		Node     result           = Fn(args...);
+		auto     elapsed          = std::chrono::steady_clock::now() - start;
+		profile.nanoseconds +=
+		  std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+		profile.calls++;
+		profile.allocations += allocationCount - startAllocations;
+		return result;
+	}
+
+	/**
+	 * Register a built-in function with an interpreter.
+	 */
+	template<Node (*Fn)(const Nodes &)>
+	void register_builtin(rego::Interpreter &rego,
+	                      const std::string &name,
+	                      const Node        &decl)
+	{
+		rego.builtins()->register_builtin(BuiltInDef::create(
+		  Location(name), decl, profiled_builtin<Fn, Nodes>));
+		profiler.name_builtin(name, builtinProfile<Fn>);
+	}
+
+	/**
+	 * Register a built-in function that operates on some state built for the
+	 * firmware image that the interpreter is auditing, such as the call
+	 * graph.  `Fn` is called with the state followed by the arguments.  The
+	 * built-in holds a reference to the state, so it remains valid for as
+	 * long as the interpreter.
+	 */
+	template<auto Fn, typename State>
+	void register_builtin(rego::Interpreter           &rego,
+	                      const std::string           &name,
+	                      const Node                  &decl,
+	                      std::shared_ptr<const State> state)
+	{
+		rego.builtins()->register_builtin(BuiltInDef::create(
+		  Location(name), decl, [state](const Nodes &args) {
+			  return profiled_builtin<Fn>(*state, args);
+		  }));
+		profiler.name_builtin(name, builtinProfile<Fn>);
+	}
+
+	/**
+	 * The inputs to an audit that are shared between all of the firmware
+	 * images being audited: the board description and any additional modules.
+	 */
+	struct AuditContext
+	{
+		/// The parsed and normalised board description.
+		nlohmann::json board;
+		/// The names and source of the modules to load.
+		std::vector<std::pair<std::string, std::string>> modules;
+		/**
+		 * The top-level sections of firmware reports to load.  If this is
+		 * empty then the whole report is loaded.
+		 */
+		std::set<std::string> inputSections;
+		/**
+		 * The directory containing the build artefacts that firmware reports
+		 * were linked from.  If this is not empty then the hashes in each
+		 * report are verified against the artefacts.
+		 */
+		std::filesystem::path buildDirectory;
+	};
+
+	/**
+	 * Read module sources from files.
+	 */
+	std::vector<std::pair<std::string, std::string>>
+	read_modules(const std::vector<std::filesystem::path> &modulePaths)
+	{
+		auto timer = profiler.phase("read_modules");
+		std::vector<std::pair<std::string, std::string>> modules;
+		for (auto &modulePath : modulePaths)
+		{
+			std::ifstream moduleStream(modulePath);
+			modules.emplace_back(
+			  modulePath.string(),
+			  std::string(std::istreambuf_iterator<char>{moduleStream}, {}));
+		}
+		return modules;
+	}
+
+	/**
+	 * Load the board description and modules for an audit.  The board
+	 * description may be omitted if every firmware report is a
+	 * snapshot, in which case the board from each snapshot is used.  If
+	 * `buildDirectory` is not empty, the hashes in each firmware report are
+	 * verified against the artefacts in that directory.  If `previous` is
+	 * not null, its board description is reused rather than parsing
+	 * `boardJSONFile` again.  Returns null if the board description cannot
+	 * be parsed.
+	 */
+	std::shared_ptr<const AuditContext>
+	load_context(const std::string                        &boardJSONFile,
+	             const std::vector<std::filesystem::path> &modules,
+	             const std::set<std::string>              &inputSections  = {},
+	             const std::filesystem::path              &buildDirectory = {},
+	             const AuditContext                       *previous = nullptr)
+	{
+		auto context            = std::make_shared<AuditContext>();
+		context->inputSections  = inputSections;
+		context->buildDirectory = buildDirectory;
+		if (previous != nullptr)
+		{
+			context->board = previous->board;
+		}
+		else if (!boardJSONFile.empty())
+		{
+			auto          timer = profiler.phase("parse_board");
+			std::ifstream boardStream(boardJSONFile);
+			auto          board = parse_board_json(
+			  std::string(std::istreambuf_iterator<char>{boardStream}, {}));
+			if (!board)
+			{
+				std::cerr << "Failed to parse board JSON" << std::endl;
+				return nullptr;
+			}
+			context->board = std::move(*board);
+		}
+		context->modules = read_modules(modules);
+		return context;
+	}
+
+	/**
+	 * Add everything in `context` that can affect the result of a query,
+	 * other than the firmware report, to `key`: the board description, every
+	 * module (including the built-in packages), the sections of the report
+	 * that are loaded, and the directory that build artefacts are verified
+	 * against.
+	 */
+	void add_context_to_key(CacheKeyBuilder &key, const AuditContext &context)
+	{
+		key.add(context.board.dump());
+		key.add(context.buildDirectory.empty()
+		          ? std::string{}
+		          : std::filesystem::absolute(context.buildDirectory).string());
+		key.add(compartmentPackage);
+		key.add(rtosPackage);
+		for (auto &[name, source] : context.modules)
+		{
+			key.add(name);
+			key.add(source);
+		}
+		for (auto &section : context.inputSections)
+		{
+			key.add(section);
+		}
+	}
+
+	/**
+	 * Returns a key identifying the inputs in `context` other than the
+	 * firmware report.  Incremental audits record this with their results
+	 * and reuse a baseline's results only if it was produced with the same
+	 * key.
+	 */
+	std::string context_key(const AuditContext &context)
+	{
+		CacheKeyBuilder key;
+		add_context_to_key(key, context);
+		return key.finish();
+	}
+
+	/**
+	 * Returns a key identifying the text of a query.  Incremental audits
+	 * record this with the results of queries that declare their
+	 * dependencies, and reuse a baseline's result only for the same text.
+	 */
+	std::string query_key(std::string_view query)
+	{
+		CacheKeyBuilder key;
+		key.add(query);
+		return key.finish();
+	}
+
+	/**
+	 * Open the result cache in `directory` for queries against the firmware
+	 * report at `reportPath` in the given context.  The key covers the
+	 * contents of the report and everything that `add_context_to_key` adds.
+	 * The report is hashed but not parsed, so that a cache hit avoids loading
+	 * it.  Returns an empty optional if the report cannot be read.
+	 */
+	std::optional<ResultCache>
+	open_result_cache(const AuditContext          &context,
+	                  const std::filesystem::path &reportPath,
+	                  const std::filesystem::path &directory)
+	{
+		CacheKeyBuilder key;
+		if (!key.add_file(reportPath))
+		{
+			return std::nullopt;
+		}
+		add_context_to_key(key, context);
+		return ResultCache{directory, key.finish()};
+	}
+
+	/**
+	 * The parsed inputs for auditing one firmware image.  This is immutable
+	 * once loaded and so can be shared between interpreters that are
+	 * evaluating queries in parallel.  The JSON form of the report is not
+	 * kept once the indexes and terms have been built from it.
+	 */
+	struct FirmwareImage
+	{
+		/// The board description and modules.
+		std::shared_ptr<const AuditContext> context;
+		/// The call graph of the firmware image.
+		std::shared_ptr<const CallGraph> callGraph;
+		/// The index of board devices and MMIO imports.
+		std::shared_ptr<const DeviceIndex> devices;
+		/// The result of the native implementation of `data.rtos.valid`.
+		std::shared_ptr<const RTOSPolicyVerdict> rtosPolicy;
+		/// The decoded contents of the image's static sealed objects.
+		std::shared_ptr<const SealedObjectContents> sealedObjects;
+		/**
+		 * The firmware report as a Rego term.  This is built once and every
+		 * interpreter is given a copy as its input, so the report is never
+		 * parsed again.
+		 */
+		std::shared_ptr<const SharedTerm> input;
+		/**
+		 * The data documents that are built natively: the board description
+		 * as `board`, the export index as `index`, the demangled names of
+		 * every export as `demangled`, the call graph as `callgraph`, the
+		 * device index as `devices`, resource accounting as `resources`, and
+		 * the results of verifying hashes against the build artefacts as
+		 * `verification` if a build directory was given.  Like `input`, this
+		 * is built once and copied into each interpreter.
+		 */
+		std::shared_ptr<const SharedTerm> data;
+	};
+
+	/**
+	 * A firmware report that has been parsed but not yet indexed.
+	 */
+	struct ParsedReport
+	{
+		/// The firmware report, containing only the requested sections.
+		nlohmann::json report;
+		/// The board description to use with the report.
+		nlohmann::json board;
+	};
+
+	/**
+	 * Read a firmware report.  The report may be either the JSON emitted by
+	 * the linker or a snapshot created with `--write-snapshot`.  If the
+	 * context has a board description then it is used in preference to the
+	 * one in a snapshot.  If `sections` is not empty, then only those
+	 * top-level sections of the report are loaded and the others are skipped
+	 * while parsing, or not decoded at all from a snapshot, and are never
+	 * held in memory.  Returns an empty optional
+	 * if the report cannot be parsed or there is no board description.
+	 */
+	std::optional<ParsedReport>
+	read_report(const AuditContext          &context,
+	            const std::filesystem::path &reportJSONFile,
+	            const std::set<std::string> &sections)
+	{
+		ParsedReport parsed{{}, context.board};
+		if (is_snapshot(reportJSONFile))
+		{
+			auto timer    = profiler.phase("read_snapshot");
+			auto snapshot = read_snapshot(
+			  reportJSONFile, sections, parsed.board.is_null());
+			if (!snapshot)
+			{
+				std::cerr << "Failed to read firmware report snapshot: "
+				          << reportJSONFile.string() << std::endl;
+				return std::nullopt;
+			}
+			parsed.report = std::move(snapshot->report);
+			if (parsed.board.is_null())
+			{
+				parsed.board = std::move(snapshot->board);
+			}
+		}
+		else
+		{
+			auto          timer = profiler.phase("parse_report");
+			std::ifstream reportStream(reportJSONFile);
+			// Skip the values of any top-level keys that are not wanted, so
+			// that they are never materialised.
+			nlohmann::json::parser_callback_t filter =
+			  [&](int                           depth,
+			      nlohmann::json::parse_event_t event,
+			      nlohmann::json               &parsed) {
+				  return (depth != 1) ||
+				         (event != nlohmann::json::parse_event_t::key) ||
+				         sections.contains(parsed.get<std::string>());
+			  };
+			parsed.report = nlohmann::json::parse(reportStream,
+			                                      sections.empty() ? nullptr
+			                                                       : filter,
+			                                      /*allow_exceptions*/ false);
+			if (parsed.report.is_discarded())
+			{
+				std::cerr << "Failed to parse firmware report JSON: "
+				          << reportJSONFile.string() << std::endl;
+				return std::nullopt;
+			}
+		}
+		if (parsed.board.is_null())
+		{
+			std::cerr << "No board description for firmware report: "
+			          << reportJSONFile.string() << std::endl;
+			return std::nullopt;
+		}
+		return parsed;
+	}
+
+	/**
+	 * Build the indexes and Rego terms for a parsed firmware report.  The
+	 * JSON form of the report is consumed: each top-level section is freed
+	 * as soon as it has been converted to a term, and nothing else is kept
+	 * once this returns, so peak memory use is the JSON form plus the terms
+	 * rather than the JSON form, a copy as text, and the terms.
+	 */
+	std::shared_ptr<const FirmwareImage>
+	build_image(std::shared_ptr<const AuditContext> context,
+	            ParsedReport                        parsed)
+	{
+		auto  image  = std::make_shared<FirmwareImage>();
+		auto &report = parsed.report;
+		nlohmann::json data;
+		{
+			auto timer = profiler.phase("build_index");
+			data       = {{"board", std::move(parsed.board)},
+			              {"index", build_index(report)}};
+		}
+		{
+			auto timer      = profiler.phase("build_device_index");
+			image->devices  =
+			  std::make_shared<DeviceIndex>(data["board"], report);
+			data["devices"] = image->devices->to_json();
+		}
+		{
+			auto timer        = profiler.phase("build_callgraph");
+			image->callGraph  = std::make_shared<CallGraph>(report);
+			data["callgraph"] = image->callGraph->to_json();
+		}
+		{
+			auto timer        = profiler.phase("demangle_exports");
+			data["demangled"] = demangledNames.insert_all(report);
+		}
+		{
+			auto timer = profiler.phase("decode_sealed_objects");
+			image->sealedObjects =
+			  std::make_shared<SealedObjectContents>(report);
+		}
+		{
+			auto timer        = profiler.phase("build_resources");
+			data["resources"] = build_resources(
+			  report, data["board"], *image->sealedObjects);
+		}
+		{
+			auto timer        = profiler.phase("check_rtos_policy");
+			image->rtosPolicy = std::make_shared<RTOSPolicyVerdict>(
+			  check_rtos_policy(report, data["board"], *image->sealedObjects));
+		}
+		if (!context->buildDirectory.empty())
+		{
+			auto timer = profiler.phase("verify_hashes");
+			data["verification"] =
+			  verify_report(report,
+			                context->buildDirectory,
+			                std::max(1U, std::thread::hardware_concurrency()));
+		}
+		{
+			auto  timer = profiler.phase("build_terms");
+			Nodes sections;
+			for (auto it = report.begin(); it != report.end();
+			     it      = report.erase(it))
+			{
+				sections.push_back(
+				  object_item(scalar(it.key()), json_to_term(*it)));
+			}
+			image->input = std::make_shared<SharedTerm>(object(sections));
+			image->data  = std::make_shared<SharedTerm>(json_to_term(data));
+		}
+		image->context = std::move(context);
+		return image;
+	}
+
+	/**
+	 * Load a firmware report for auditing in the given context, loading only
+	 * the sections that the context requests.  Returns null if the report
+	 * cannot be parsed.
+	 */
+	std::shared_ptr<const FirmwareImage>
+	load_image(std::shared_ptr<const AuditContext> context,
+	           const std::filesystem::path        &reportJSONFile)
+	{
+		auto parsed =
+		  read_report(*context, reportJSONFile, context->inputSections);
+		if (!parsed)
+		{
+			return nullptr;
+		}
+		return build_image(std::move(context), std::move(*parsed));
+	}
+
+	/**
+	 * Expand the list of firmware reports passed on the command line.  Any
+	 * directories are replaced by the JSON files and snapshots that they
+	 * contain, in sorted order.
+	 */
+	std::vector<std::filesystem::path>
+	expand_reports(const std::vector<std::filesystem::path> &paths)
+	{
+		std::vector<std::filesystem::path> reports;
+		for (auto &path : paths)
+		{
+			if (!std::filesystem::is_directory(path))
+			{
+				reports.push_back(path);
+				continue;
+			}
+			std::vector<std::filesystem::path> contents;
+			for (auto &entry : std::filesystem::directory_iterator(path))
+			{
+				if (entry.is_regular_file() &&
+				    ((entry.path().extension() == ".json") ||
+				     (entry.path().extension() == ".snapshot")))
+				{
+					contents.push_back(entry.path());
+				}
+			}
+			std::sort(contents.begin(), contents.end());
+			reports.insert(reports.end(), contents.begin(), contents.end());
+		}
+		return reports;
+	}
+
+	/**
+	 * Create an interpreter with the built-in functions and modules registered
+	 * and the inputs from `image` loaded.  The time taken is not recorded, so
+	 * callers must record it as part of a phase.
+	 */
+	std::unique_ptr<rego::Interpreter>
+	create_untimed_interpreter(const FirmwareImage &image)
+	{
+		auto rego = std::make_unique<rego::Interpreter>();
+		register_builtin<demangle_export>(
+		  *rego, "export_entry_demangle", demangle_export_decl);
+		register_builtin<demangle_export_table>(
+		  *rego, "export_table_demangle", demangle_export_table_decl);
+		register_builtin<match_export_table>(
+		  *rego, "export_table_match", match_export_table_decl);
+		register_builtin<callgraph_reachable>(*rego,
+		                                      "callgraph_reachable",
+		                                      callgraph_reachable_decl,
+		                                      image.callGraph);
+		register_builtin<callgraph_path>(
+		  *rego, "callgraph_path", callgraph_path_decl, image.callGraph);
+		register_builtin<mmio_device_at>(
+		  *rego, "mmio_device_at", mmio_device_at_decl, image.devices);
+		register_builtin<mmio_devices_overlapping>(*rego,
+		                                           "mmio_devices_overlapping",
+		                                           mmio_range_decl,
+		                                           image.devices);
+		register_builtin<mmio_importers>(
+		  *rego, "mmio_importers", mmio_range_decl, image.devices);
+		register_builtin<rtos_policy>(
+		  *rego, "rtos_policy", rtos_policy_decl, image.rtosPolicy);
+		register_builtin<decode_integer>(*rego,
+		                                 "integer_from_hex_string",
+		                                 decode_integer_decl,
+		                                 image.sealedObjects);
+		register_builtin<decode_c_string>(*rego,
+		                                  "string_from_hex_string",
+		                                  decode_c_string_decl,
+		                                  image.sealedObjects);
+		register_builtin<decode_sealed_object>(*rego,
+		                                       "decode_sealed_object",
+		                                       decode_sealed_object_decl,
+		                                       image.sealedObjects);
+		rego->set_input(image.input->copy());
+		rego->add_data(image.data->copy());
+		rego->add_module("compartment", compartmentPackage);
+		rego->add_module("rtos", rtosPackage);
+		for (auto &[name, source] : image.context->modules)
+		{
+			rego->add_module(name, source);
+		}
+		return rego;
+	}
+
+	/**
+	 * Create an interpreter for `image`, recording the time taken as the
+	 * `create_interpreter` phase.
+	 */
+	std::unique_ptr<rego::Interpreter>
+	create_interpreter(const FirmwareImage &image)
+	{
+		auto timer = profiler.phase("create_interpreter");
+		return create_untimed_interpreter(image);
+	}
+
+	/**
+	 * Evaluate a set of queries against a firmware image, using up to `jobs`
+	 * threads.  Each worker thread has its own interpreter, and the queries
+	 * are handed out to workers in order.  The results are returned in the
+	 * same order as the queries, independent of the number of workers.  If
+	 * `cache` is not null then the full result of each query is stored in
+	 * it.
+	 */
+	std::vector<std::string> evaluate_queries(
+	  const FirmwareImage                                    &image,
+	  const std::vector<std::pair<std::string, std::string>> &queries,
+	  unsigned                                                jobs,
+	  const ResultCache                                      *cache = nullptr)
+	{
+		std::vector<std::string> results(queries.size());
+		std::atomic<size_t>      next   = 0;
+		auto                     worker = [&]() {
+			auto rego = create_interpreter(image);
+			for (size_t i = next++; i < queries.size(); i = next++)
+			{
+				auto timer  = profiler.phase("evaluate");
+				auto result = rego->query(queries[i].second);
+				if (cache != nullptr)
+				{
+					cache->store(queries[i].second, result);
+				}
+				results[i] = extract_first_expression_from_result(result);
+			}
+		};
+		jobs = std::max(1U, std::min<unsigned>(jobs, queries.size()));
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < jobs; i++)
+		{
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (auto &thread : threads)
+		{
+			thread.join();
+		}
+		return results;
+	}
+
+	/**
+	 * Evaluate a set of queries against each of a set of firmware reports,
+	 * using up to `jobs` threads.  Each worker thread loads one report at a
+	 * time and evaluates all of the queries against it.  Returns the results
+	 * for each report in order, or an empty optional for reports that could
+	 * not be loaded.
+	 *
+	 * The board and module sources in `context` are shared, but each report
+	 * gets a new interpreter, which compiles the modules again.  An
+	 * interpreter cannot be reused for another report, because its built-in
+	 * functions are bound to the indexes of one image and data documents
+	 * can be added to it but not removed.
+	 */
+	std::vector<std::optional<std::vector<std::string>>> evaluate_images(
+	  const std::shared_ptr<const AuditContext>              &context,
+	  const std::vector<std::filesystem::path>               &reports,
+	  const std::vector<std::pair<std::string, std::string>> &queries,
+	  unsigned                                                jobs)
+	{
+		std::vector<std::optional<std::vector<std::string>>> results(
+		  reports.size());
+		std::atomic<size_t> next   = 0;
+		auto                worker = [&]() {
+			for (size_t i = next++; i < reports.size(); i = next++)
+			{
+				if (auto image = load_image(context, reports[i]))
+				{
+					results[i] = evaluate_queries(*image, queries, 1);
+				}
+			}
+		};
+		jobs = std::max(1U, std::min<unsigned>(jobs, reports.size()));
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < jobs; i++)
+		{
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (auto &thread : threads)
+		{
+			thread.join();
+		}
+		return results;
+	}
+
+	/**
+	 * Find the names of the rules in a module that do not take arguments.
+	 * This is a simple scan for lines of the form `name if {` and so only
+	 * works for the built-in modules, which are formatted consistently.
+	 */
+	std::vector<std::string> complete_rules(std::string_view module)
+	{
+		std::vector<std::string> rules;
+		while (!module.empty())
+		{
+			size_t           end  = module.find('\n');
+			std::string_view line = module.substr(0, end);
+			module.remove_prefix(
+			  end == std::string_view::npos ? module.size() : end + 1);
+			line.remove_prefix(std::min(line.find_first_not_of(" \t"),
+			                            line.size()));
+			size_t nameEnd = line.find(" if {");
+			if ((nameEnd == std::string_view::npos) || (nameEnd == 0))
+			{
+				continue;
+			}
+			auto name = line.substr(0, nameEnd);
+			if (std::all_of(name.begin(), name.end(), [](char c) {
+				    return std::isalnum(static_cast<unsigned char>(c)) ||
+				           (c == '_');
+			    }) &&
+			    (std::find(rules.begin(), rules.end(), name) == rules.end()))
+			{
+				rules.emplace_back(name);
+			}
+		}
+		return rules;
+	}
+
+	/**
+	 * Evaluate each of the rules that do not take arguments in the built-in
+	 * packages, recording the time taken for each one.  Rules that are
+	 * functions cannot be evaluated without arguments, so their cost is
+	 * included in the rules and queries that call them.  This uses its own
+	 * interpreter, and the time to create it and evaluate the rules is
+	 * recorded as the `profile_rules` phase, so that it is not counted in
+	 * the `create_interpreter` or `evaluate` phases of the audit itself.
+	 */
+	void profile_builtin_rules(const FirmwareImage &image)
+	{
+		auto timer = profiler.phase("profile_rules");
+		auto rego  = create_untimed_interpreter(image);
+		for (auto [package, source] : {std::pair{"compartment",
+		                                         compartmentPackage},
+		                               std::pair{"rtos", rtosPackage}})
+		{
+			for (auto &rule : complete_rules(source))
+			{
+				std::string query =
+				  std::string("data.") + package + "." + rule;
+				auto timer = profiler.rule(query);
+				rego->query(query);
+			}
+		}
+	}
+
+	/**
+	 * Write the profile collected for this run to `filename`.
+	 */
+	void write_profile(const std::string &filename)
+	{
+		std::ofstream out(filename);
+		out << profiler.report().dump(1) << std::endl;
+	}
+
+	/**
+	 * Cache of loaded firmware images for server mode.  Interpreters are keyed
+	 * by a hash of the contents of the firmware report, along with the board
+	 * file and modules that were loaded alongside it, so that rebuilding an
+	 * image with the same contents does not require reloading it.  At most
+	 * `capacity` interpreters are kept, and the least recently used one is
+	 * discarded to make room for another.
+	 */
+	class ImageCache
+	{
+		/**
+		 * Identity of a file on disk.  If none of these have changed then we
+		 * assume that the file contents have not changed either.
+		 */
+		using FileIdentity = std::tuple<std::filesystem::path,
+		                                std::filesystem::file_time_type,
+		                                std::uintmax_t>;
+
+		/**
+		 * The identity and contents hash of the most recent version of each
+		 * firmware report, keyed by path, so that we don't need to read a
+		 * report to find its hash if it has not changed since the last
+		 * request.  Only reports used by a loaded interpreter are kept.
+		 */
+		std::map<std::filesystem::path, std::pair<FileIdentity, std::string>>
+		  reportHashes;
+
+		/**
+		 * A loaded interpreter, the canonical path of its firmware report,
+		 * and its position in `recent`.
+		 */
+		struct Entry
+		{
+			std::unique_ptr<rego::Interpreter> interpreter;
+			std::filesystem::path              report;
+			std::list<std::string>::iterator   position;
+		};
+
+		/// The maximum number of interpreters to keep.
+		size_t capacity;
+
+		/// The keys of the loaded interpreters, most recently used first.
+		std::list<std::string> recent;
+
+		/**
+		 * Loaded interpreters.
+		 */
+		std::map<std::string, Entry> images;
+
+		static FileIdentity identity(const std::filesystem::path &path)
+		{
+			auto canonical = std::filesystem::canonical(path);
+			return {canonical,
+			        std::filesystem::last_write_time(canonical),
+			        std::filesystem::file_size(canonical)};
+		}
+
+		/**
+		 * Returns the canonical path of a firmware report and the hash of
+		 * its contents, hashing it only if we have not seen this version of
+		 * the file before.  The report is not parsed.
+		 */
+		std::pair<std::filesystem::path, std::string>
+		report_hash(const std::filesystem::path &report)
+		{
+			auto  key   = identity(report);
+			auto &entry = reportHashes[std::get<0>(key)];
+			if (entry.first != key)
+			{
+				CacheKeyBuilder hash;
+				if (!hash.add_file(std::get<0>(key)))
+				{
+					throw std::runtime_error("Failed to read firmware report");
+				}
+				entry = {key, hash.finish()};
+			}
+			return {std::get<0>(key), entry.second};
+		}
+
+		/**
+		 * Forget the hashes of firmware reports that no loaded interpreter
+		 * uses, either because their interpreters have been evicted or
+		 * because they failed to load, so that `reportHashes` does not grow
+		 * with every report that has ever been requested.
+		 */
+		void prune_report_hashes()
+		{
+			std::erase_if(reportHashes, [&](auto &reportHash) {
+				return std::none_of(
+				  images.begin(), images.end(), [&](auto &image) {
+					  return image.second.report == reportHash.first;
+				  });
+			});
+		}
+
+		public:
+		explicit ImageCache(size_t capacity) : capacity(capacity) {}
+
+		/**
+		 * Find or load the interpreter for the given set of inputs.  Throws
+		 * an exception (from the filesystem layer) if the inputs cannot be
+		 * read and returns null if they cannot be parsed.  The result is
+		 * valid until the next call.
+		 */
+		rego::Interpreter *
+		get(const std::string                        &boardJSONFile,
+		    const std::string                        &firmwareReportJSONFile,
+		    const std::vector<std::filesystem::path> &modules)
+		{
+			prune_report_hashes();
+			auto [report, reportHash] = report_hash(firmwareReportJSONFile);
+			std::stringstream key;
+			key << reportHash;
+			auto addFile = [&](const std::filesystem::path &path) {
+				auto [canonical, time, size] = identity(path);
+				key << '\0' << canonical.string() << '\0'
+				    << time.time_since_epoch().count() << '\0' << size;
+			};
+			addFile(boardJSONFile);
+			for (auto &module : modules)
+			{
+				addFile(module);
+			}
+			if (auto it = images.find(key.str()); it != images.end())
+			{
+				recent.splice(recent.begin(), recent, it->second.position);
+				return it->second.interpreter.get();
+			}
+			auto context = load_context(boardJSONFile, modules);
+			auto image =
+			  context ? load_image(context, firmwareReportJSONFile) : nullptr;
+			if (!image)
+			{
+				return nullptr;
+			}
+			if (images.size() >= capacity)
+			{
+				images.erase(recent.back());
+				recent.pop_back();
+			}
+			recent.push_front(key.str());
+			auto &entry = images[key.str()] = {
+			  create_interpreter(*image), report, recent.begin()};
+			return entry.interpreter.get();
+		}
+	};
+
+	/**
+	 * Run as a server.  Each line read from `in` is a JSON object describing
+	 * a request, with `board`, `firmware-report` and `query` fields and
+	 * optional `modules` and `id` fields.  Each response is written to `out`
+	 * as a single line of JSON, containing the `id` from the request and
+	 * either a `result` or an `error`.  At most `cacheSize` loaded images
+	 * are kept.
+	 */
+	void serve(std::istream &in, std::ostream &out, size_t cacheSize)
+	{
+		ImageCache  cache{cacheSize};
+		std::string line;
+		while (std::getline(in, line))
+		{
+			if (line.empty())
+			{
+				continue;
+			}
+			nlohmann::ordered_json response;
+			try
+			{
+				auto request = nlohmann::json::parse(line);
+				if (request.contains("id"))
+				{
+					response["id"] = request["id"];
+				}
+				std::vector<std::filesystem::path> modules;
+				if (request.contains("modules"))
+				{
+					for (auto &module : request["modules"])
+					{
+						modules.emplace_back(module.get<std::string>());
+					}
+				}
+				auto *rego =
+				  cache.get(request.at("board").get<std::string>(),
+				            request.at("firmware-report").get<std::string>(),
+				            modules);
+				if (rego == nullptr)
+				{
+					response["error"] = "Failed to load firmware image";
+				}
+				else
+				{
+					add_result(response,
+					           extract_first_expression_from_result(rego->query(
+					             request.at("query").get<std::string>())));
+				}
+			}
+			catch (std::exception &e)
+			{
+				response["error"] = e.what();
+			}
+			out << response.dump() << std::endl;
+		}
+	}
+
+	/**
+	 * A function that loads the board description and modules for watch
+	 * mode, reusing the board description from the context that it is
+	 * passed if that is not null.
+	 */
+	using ContextLoader =
+	  std::function<std::shared_ptr<const AuditContext>(const AuditContext *)>;
+
+	/**
+	 * Watch mode.  Evaluate `query`, or the queries in `queryFile` if it is
+	 * not empty, against the firmware report at `reportFile`, and then
+	 * evaluate them again each time that any of the inputs changes, until
+	 * the process is killed.  `loadContext` loads the board description
+	 * from `boardFile` and the modules from `moduleFiles`.
+	 *
+	 * Only what changed is reloaded, as decided by `watch_reload`.  The
+	 * board description is parsed again only if it changed, and the report
+	 * only if it or the board description changed.  If only modules
+	 * changed, the loaded image is reused with the new modules; this copies
+	 * only the pointers to its indexes and terms.  If only the query file
+	 * changed, the existing interpreter is reused, so the new queries are
+	 * evaluated without compiling any modules.  Errors in the inputs are
+	 * reported and evaluation resumes once they are fixed.
+	 */
+	[[noreturn]] void watch(const ContextLoader                      &loadContext,
+	                        const std::filesystem::path              &boardFile,
+	                        const std::vector<std::filesystem::path> &moduleFiles,
+	                        const std::filesystem::path              &reportFile,
+	                        const std::string                        &query,
+	                        const std::string                        &queryFile,
+	                        OutputFormat                              format,
+	                        std::ostream                             &out)
+	{
+		std::vector<std::filesystem::path> watched = moduleFiles;
+		watched.push_back(reportFile);
+		if (!boardFile.empty())
+		{
+			watched.push_back(boardFile);
+		}
+		if (!queryFile.empty())
+		{
+			watched.push_back(queryFile);
+		}
+		FileWatcher watcher(watched);
+		auto        readQueries = [&]() {
+			std::vector<std::pair<std::string, std::string>> queries;
+			if (queryFile.empty())
+			{
+				queries.emplace_back("", query);
+			}
+			else if (!read_query_file(queryFile, queries))
+			{
+				std::cerr << "Failed to parse query file" << std::endl;
+			}
+			return queries;
+		};
+		auto                                 context = loadContext(nullptr);
+		std::shared_ptr<const FirmwareImage> image =
+		  context ? load_image(context, reportFile) : nullptr;
+		std::unique_ptr<rego::Interpreter> rego;
+		auto                               queries = readQueries();
+		for (;;)
+		{
+			if (image && !rego)
+			{
+				rego = create_interpreter(*image);
+			}
+			if (rego)
+			{
+				auto start = std::chrono::steady_clock::now();
+				for (auto &[name, queryText] : queries)
+				{
+					auto result = rego->query(queryText);
+					if (queryFile.empty())
+					{
+						write_query_result(out, result, format);
+					}
+					else
+					{
+						out << batch_result(
+						         name, extract_first_expression_from_result(result))
+						    << std::endl;
+					}
+				}
+				auto elapsed = std::chrono::steady_clock::now() - start;
+				std::cerr << "Evaluated in "
+				          << std::chrono::duration_cast<std::chrono::milliseconds>(
+				               elapsed)
+				               .count()
+				          << "ms, watching for changes" << std::endl;
+			}
+			auto reload = watch_reload(watcher.wait(),
+			                           boardFile,
+			                           moduleFiles,
+			                           reportFile,
+			                           queryFile,
+			                           context != nullptr,
+			                           image != nullptr);
+			if (reload.board || reload.modules)
+			{
+				context = loadContext(reload.board ? nullptr : context.get());
+			}
+			if (reload.interpreter)
+			{
+				rego.reset();
+			}
+			if (!context)
+			{
+				image = nullptr;
+			}
+			else if (reload.report)
+			{
+				image = load_image(context, reportFile);
+			}
+			else if (image->context != context)
+			{
+				auto reloaded     = std::make_shared<FirmwareImage>(*image);
+				reloaded->context = context;
+				image             = std::move(reloaded);
+			}
+			if (reload.queries)
+			{
+				queries = readQueries();
+			}
+		}
+	}
+} // namespace
+
+int main(int argc, char **argv)
+{
+	CLI::App                           app{"Audit a CHERIoT firmware image"};
+	std::string                        boardJSONFile;
+	std::vector<std::filesystem::path> firmwareReportJSONFiles;
+	std::vector<std::filesystem::path> modules;
+	std::string                        query;
+	std::string                        queryFile;
+	bool                               serverMode     = false;
+	size_t                             serveCacheSize = 8;
+	unsigned                           jobs           = 1;
+	std::string                        profileFile;
+	std::string                        snapshotFile;
+	std::string                        baselineReport;
+	std::string                        baselineResults;
+	std::vector<std::string>           inputSections;
+	std::string                        buildDirectory;
+	std::string                        cacheDirectory;
+	bool                               watchMode    = false;
+	OutputFormat                       outputFormat = OutputFormat::First;
+	auto                              *boardOption =
+	  app.add_option("-b,--board", boardJSONFile, "Board JSON file")
+	    ->check(CLI::ExistingFile);
+	app
+	  .add_option("-m,--module",
+	              modules,
+	              "Modules to load.  This option may be passed more than once.")
+	  ->check(CLI::ExistingFile);
+	auto *writeSnapshotOption =
+	  app.add_option("--write-snapshot",
+	                 snapshotFile,
+	                 "Write the firmware report and board description to this "
+	                 "file as a binary snapshot, which can be passed to -j "
+	                 "in place of the report, and exit.");
+	auto *queryOption = app.add_option("-q,--query", query, "The query to run.");
+	auto *queryFileOption =
+	  app
+	    .add_option("--query-file",
+	                queryFile,
+	                "JSON file containing an object mapping names to queries.  "
+	                "All queries are run against the same loaded firmware "
+	                "image.")
+	    ->check(CLI::ExistingFile)
+	    ->excludes(queryOption);
+	auto *outputFormatOption =
+	  app
+	    .add_option("--output-format",
+	                outputFormat,
+	                "Format for the result of --query: 'first' (the default) "
+	                "writes the first expression of the first result as JSON, "
+	                "'json' writes the full result set, 'jsonl' writes one "
+	                "line per element of the result, and 'cbor' writes the "
+	                "full result set as CBOR.")
+	    ->transform(CLI::CheckedTransformer(
+	      std::map<std::string, OutputFormat>{
+	        {"first", OutputFormat::First},
+	        {"json", OutputFormat::JSON},
+	        {"jsonl", OutputFormat::JSONLines},
+	        {"cbor", OutputFormat::CBOR}}))
+	    ->excludes(queryFileOption);
+	app
+	  .add_option("--input-sections",
+	              inputSections,
+	              "Comma-separated list of the top-level sections of the "
+	              "firmware report (for example, compartments,threads) to "
+	              "load.  Other sections are skipped while parsing, which "
+	              "reduces memory use for large reports.")
+	  ->delimiter(',');
+	auto *verifyOption =
+	  app
+	    .add_option("--verify-build-dir",
+	                buildDirectory,
+	                "Build directory that the firmware report was linked in.  "
+	                "The input sections and final image named in the report "
+	                "are hashed in parallel and compared against the hashes "
+	                "in the report, and the results are exposed as "
+	                "data.verification.")
+	    ->check(CLI::ExistingDirectory);
+	auto *cacheOption =
+	  app
+	    .add_option("--cache-dir",
+	                cacheDirectory,
+	                "Directory in which to cache query results.  Results are "
+	                "keyed on the firmware report, board description, "
+	                "modules, and query, and a cached result is returned "
+	                "without loading the report.")
+	    ->excludes(verifyOption);
+	auto *baselineOption =
+	  app
+	    .add_option("--baseline",
+	                baselineReport,
+	                "Firmware report for a previous build of the same image.  "
+	                "Queries in the query file that declare their "
+	                "dependencies reuse the results from --baseline-results "
+	                "if nothing that they depend on has changed.")
+	    ->check(CLI::ExistingFile)
+	    ->needs(queryFileOption);
+	auto *baselineResultsOption =
+	  app
+	    .add_option("--baseline-results",
+	                baselineResults,
+	                "Output of running the same query file against the "
+	                "--baseline report.")
+	    ->check(CLI::ExistingFile)
+	    ->needs(baselineOption);
+	baselineOption->needs(baselineResultsOption);
+	app.add_option("-J,--jobs",
+	               jobs,
+	               "Number of threads to use for evaluating the queries in a "
+	               "query file, or for auditing multiple firmware reports.");
+	app.add_option("--profile",
+	               profileFile,
+	               "Write timing information for the phases of the audit, "
+	               "built-in functions, and built-in rules to this file as "
+	               "JSON.");
+	auto *reportOption =
+	  app
+	    .add_option("-j,--firmware-report",
+	                firmwareReportJSONFiles,
+	                "Firmware report JSON file generated by the linker.  This "
+	                "option may be passed more than once, or given a "
+	                "directory of reports, to audit several images.")
+	    ->check(CLI::ExistingPath);
+	auto *watchOption =
+	  app
+	    .add_flag("--watch",
+	              watchMode,
+	              "Keep running after evaluating the query or query file, and "
+	              "evaluate it again whenever the firmware report, board "
+	              "description, modules, or query file change.")
+	    ->excludes(cacheOption)
+	    ->excludes(baselineOption)
+	    ->excludes(writeSnapshotOption);
+	app
+	  .add_flag("--serve",
+	            serverMode,
+	            "Run as a server, reading one JSON request per line from "
+	            "standard input and keeping loaded images resident.")
+	  ->excludes(boardOption)
+	  ->excludes(reportOption)
+	  ->excludes(queryOption)
+	  ->excludes(queryFileOption)
+	  ->excludes(writeSnapshotOption)
+	  ->excludes(watchOption);
+	app
+	  .add_option("--serve-cache-size",
+	              serveCacheSize,
+	              "Maximum number of loaded images to keep resident in "
+	              "server mode.  The least recently used image is discarded "
+	              "when another is loaded.")
+	  ->check(CLI::PositiveNumber);
+	CLI11_PARSE(app, argc, argv);
+	if (serverMode)
+	{
+		serve(std::cin, std::cout, serveCacheSize);
+		return EXIT_SUCCESS;
+	}
+	if (reportOption->count() == 0)
+	{
+		std::cerr << "--firmware-report is required" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!snapshotFile.empty())
+	{
+		if ((boardOption->count() == 0) ||
+		    (firmwareReportJSONFiles.size() != 1))
+		{
+			std::cerr << "--write-snapshot requires --board and a single "
+			             "--firmware-report"
+			          << std::endl;
+			return EXIT_FAILURE;
+		}
+		auto context = load_context(boardJSONFile, {});
+		auto parsed =
+		  context ? read_report(*context, firmwareReportJSONFiles.front(), {})
+		          : std::nullopt;
+		if (!parsed ||
+		    !write_snapshot(snapshotFile, parsed->report, parsed->board))
+		{
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	std::vector<std::pair<std::string, std::string>> queries;
+	QueryDependencies                                dependencies;
+	if (!queryFile.empty())
+	{
+		if (!read_query_file(queryFile, queries, &dependencies))
+		{
+			std::cerr << "Failed to parse query file" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	else if (queryOption->count() == 0)
+	{
+		std::cerr << "Either --query or --query-file is required" << std::endl;
+		return EXIT_FAILURE;
+	}
+	profiler.enabled = !profileFile.empty();
+	auto finish      = [&](int exitCode) {
+		if (profiler.enabled)
+		{
+			write_profile(profileFile);
+		}
+		return exitCode;
+	};
+	if (watchMode)
+	{
+		if ((firmwareReportJSONFiles.size() != 1) ||
+		    std::filesystem::is_directory(firmwareReportJSONFiles.front()))
+		{
+			std::cerr << "--watch requires a single --firmware-report"
+			          << std::endl;
+			return EXIT_FAILURE;
+		}
+		watch(
+		  [&](const AuditContext *previous) {
+			  return load_context(
+			    boardJSONFile,
+			    modules,
+			    std::set<std::string>(inputSections.begin(),
+			                          inputSections.end()),
+			    buildDirectory,
+			    previous);
+		  },
+		  boardJSONFile,
+		  modules,
+		  firmwareReportJSONFiles.front(),
+		  query,
+		  queryFile,
+		  outputFormat,
+		  std::cout);
+	}
+	auto context = load_context(
+	  boardJSONFile,
+	  modules,
+	  std::set<std::string>(inputSections.begin(), inputSections.end()),
+	  buildDirectory);
+	if (!context)
+	{
+		return EXIT_FAILURE;
+	}
+	auto reports = expand_reports(firmwareReportJSONFiles);
+	if (reports.empty())
+	{
+		std::cerr << "No firmware reports found in the --firmware-report "
+		             "directories"
+		          << std::endl;
+		return EXIT_FAILURE;
+	}
+	if ((reports.size() == 1) &&
+	    !std::filesystem::is_directory(firmwareReportJSONFiles.front()))
+	{
+		std::optional<ResultCache> cache;
+		if (!cacheDirectory.empty())
+		{
+			auto timer = profiler.phase("hash_inputs");
+			cache = open_result_cache(*context, reports.front(), cacheDirectory);
+		}
+		// Results for batch mode, either from the cache or, in an incremental
+		// audit, from the baseline.
+		std::vector<std::optional<std::string>> reused(queries.size());
+		// If any query declares its dependencies then the output may be used
+		// as the baseline for an incremental audit, so start it with the key
+		// for the inputs other than the report and the key for the text of
+		// each query that declares its dependencies.
+		std::string inputsKey = context_key(*context);
+		auto        writeInputsKey = [&]() {
+			if (dependencies.empty())
+			{
+				return;
+			}
+			nlohmann::json line{{"inputs", inputsKey},
+			                    {"queries", nlohmann::json::object()}};
+			for (auto &[name, text] : queries)
+			{
+				if (dependencies.contains(name))
+				{
+					line["queries"][name] = query_key(text);
+				}
+			}
+			std::cout << line.dump() << std::endl;
+		};
+		if (cache)
+		{
+			auto timer = profiler.phase("cache_lookup");
+			if (queryFile.empty())
+			{
+				if (auto cached = cache->lookup(query))
+				{
+					write_query_result(std::cout, *cached, outputFormat);
+					return finish(EXIT_SUCCESS);
+				}
+			}
+			for (size_t i = 0; i < queries.size(); i++)
+			{
+				if (auto cached = cache->lookup(queries[i].second))
+				{
+					reused[i] = batch_result(
+					  queries[i].first,
+					  extract_first_expression_from_result(*cached));
+				}
+			}
+			if (!queryFile.empty() &&
+			    std::all_of(reused.begin(), reused.end(), [](auto &result) {
+				    return result.has_value();
+			    }))
+			{
+				writeInputsKey();
+				for (auto &result : reused)
+				{
+					std::cout << *result << std::endl;
+				}
+				return finish(EXIT_SUCCESS);
+			}
+		}
+		auto parsed =
+		  read_report(*context, reports.front(), context->inputSections);
+		if (!parsed)
+		{
+			return EXIT_FAILURE;
+		}
+		// In an incremental audit, queries whose dependencies have not
+		// changed since the baseline reuse the baseline's result.  The
+		// reports are compared before the image is built, because building
+		// it consumes the parsed report.
+		if (!baselineReport.empty())
+		{
+			auto previous = read_baseline_results(baselineResults);
+			if (!previous)
+			{
+				std::cerr << "Failed to load baseline" << std::endl;
+				return EXIT_FAILURE;
+			}
+			if (previous->inputs != inputsKey)
+			{
+				std::cerr << "warning: the baseline results were produced with "
+				             "a different board, modules, or build directory, "
+				             "evaluating every query"
+				          << std::endl;
+				previous->results.clear();
+			}
+			// The queries that may reuse a baseline result, because the
+			// baseline has a result for the same query text, and the
+			// top-level sections of the baseline that are needed to decide
+			// whether they can.
+			std::vector<size_t>   candidates;
+			std::set<std::string> sections;
+			for (size_t i = 0; i < queries.size(); i++)
+			{
+				auto &[name, text] = queries[i];
+				auto  previousText = previous->queries.find(name);
+				if (!reused[i] && dependencies.contains(name) &&
+				    previous->results.contains(name) &&
+				    (previousText != previous->queries.end()) &&
+				    (previousText->second == query_key(text)))
+				{
+					candidates.push_back(i);
+					for (auto &dependency : dependencies[name])
+					{
+						sections.insert(
+						  dependency.substr(0, dependency.find('.')));
+					}
+				}
+			}
+			if (!candidates.empty())
+			{
+				auto baseline = read_report(*context, baselineReport, sections);
+				if (!baseline)
+				{
+					std::cerr << "Failed to load baseline" << std::endl;
+					return EXIT_FAILURE;
+				}
+				// Sections that are loaded only from the current report are
+				// reported as changed, but no candidate depends on them.
+				auto changes =
+				  changed_sections(baseline->report, parsed->report);
+				for (auto i : candidates)
+				{
+					auto &name = queries[i].first;
+					if (!depends_on_changes(dependencies[name], changes))
+					{
+						reused[i] = previous->results[name].dump();
+					}
+				}
+			}
+		}
+		auto image = build_image(context, std::move(*parsed));
+		if (queryFile.empty())
+		{
+			auto rego   = create_interpreter(*image);
+			auto timer  = profiler.phase("evaluate");
+			auto result = rego->query(query);
+			if (cache)
+			{
+				cache->store(query, result);
+			}
+			write_query_result(std::cout, result, outputFormat);
+		}
+		else
+		{
+			// Batch mode: evaluate every query against the image that we've
+			// already loaded and emit one JSON object per line.  Queries
+			// whose result was cached, or, in an incremental audit, whose
+			// dependencies have not changed since the baseline, reuse that
+			// result instead.
+			std::vector<std::pair<std::string, std::string>> changed;
+			for (size_t i = 0; i < queries.size(); i++)
+			{
+				if (!reused[i])
+				{
+					changed.push_back(queries[i]);
+				}
+			}
+			auto results = evaluate_queries(
+			  *image, changed, jobs, cache ? &*cache : nullptr);
+			writeInputsKey();
+			for (size_t i = 0, next = 0; i < queries.size(); i++)
+			{
+				std::cout << (reused[i] ? *reused[i]
+				                        : batch_result(queries[i].first,
+				                                       results[next++]))
+				          << std::endl;
+			}
+		}
+		if (profiler.enabled)
+		{
+			profile_builtin_rules(*image);
+		}
+		return finish(EXIT_SUCCESS);
+	}
+	// Multiple images: evaluate the queries against every image and emit one
+	// JSON object per line for each (image, query) pair.
+	if (outputFormatOption->count() > 0)
+	{
+		std::cerr << "--output-format requires a single --firmware-report"
+		          << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!baselineReport.empty())
+	{
+		std::cerr << "--baseline requires a single --firmware-report"
+		          << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!cacheDirectory.empty())
+	{
+		std::cerr << "--cache-dir requires a single --firmware-report"
+		          << std::endl;
+		return EXIT_FAILURE;
+	}
+	bool singleQuery = queryFile.empty();
+	if (singleQuery)
+	{
+		queries.emplace_back("", query);
+	}
+	auto results  = evaluate_images(context, reports, queries, jobs);
+	int  exitCode = EXIT_SUCCESS;
+	for (size_t i = 0; i < reports.size(); i++)
+	{
+		if (!results[i])
+		{
+			nlohmann::ordered_json line;
+			line["report"] = reports[i].string();
+			line["error"]  = "Failed to load firmware report";
+			std::cout << line.dump() << std::endl;
+			exitCode = EXIT_FAILURE;
+			continue;
+		}
+		for (size_t q = 0; q < queries.size(); q++)
+		{
+			nlohmann::ordered_json line;
+			line["report"] = reports[i].string();
+			if (!singleQuery)
+			{
+				line["name"] = queries[q].first;
+			}
+			add_result(line, (*results[i])[q]);
+			std::cout << line.dump() << std::endl;
+		}
 	}
-	std::cout << extract_first_expression_from_result(rego.query(query))
-	          << std::endl;
+	return finish(exitCode);
 }
@@ -0,0 +1,103 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <charconv>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace
+{
+	/**
+	 * Rewrite the hex literals in a board description to decimal.  The board
+	 * files are *almost* JSON, with the exception that they use 0x for hex
+	 * numbers.  This makes a single pass over the input, copying everything
+	 * except hex literals outside of strings verbatim, so the cost is linear
+	 * in the size of the file.  Returns an empty optional if a hex literal is
+	 * malformed.
+	 */
+	std::optional<std::string> rewrite_hex_literals(std::string_view input)
+	{
+		std::string output;
+		output.reserve(input.size());
+		bool inString = false;
+		for (size_t i = 0; i < input.size(); i++)
+		{
+			char c = input[i];
+			if (inString)
+			{
+				output.push_back(c);
+				if (c == '\\' && (i + 1 < input.size()))
+				{
+					output.push_back(input[++i]);
+				}
+				else if (c == '"')
+				{
+					inString = false;
+				}
+				continue;
+			}
+			if (c == '"')
+			{
+				inString = true;
+			}
+			else if ((c == '0') && (i + 1 < input.size()) &&
+			         ((input[i + 1] == 'x') || (input[i + 1] == 'X')))
+			{
+				uint64_t    value;
+				const char *start = input.data() + i + 2;
+				const char *end   = input.data() + input.size();
+				auto [next, error] = std::from_chars(start, end, value, 16);
+				if ((error != std::errc{}) || (next == start))
+				{
+					return std::nullopt;
+				}
+				char buffer[24];
+				auto [bufferEnd, ec] =
+				  std::to_chars(buffer, buffer + sizeof(buffer), value);
+				output.append(buffer, bufferEnd);
+				i = (next - input.data()) - 1;
+				continue;
+			}
+			output.push_back(c);
+		}
+		return output;
+	}
+
+	/**
+	 * Parse a board description.  Hex literals are accepted and, once the
+	 * JSON is parsed, devices are normalised slightly.  Devices can be
+	 * expressed as start and end or start and length.  In the linker report,
+	 * they're always start and length, so we'll convert any end to a length.
+	 *
+	 * Returns an empty optional on failure.
+	 */
+	std::optional<nlohmann::json> parse_board_json(std::string_view input)
+	{
+		auto rewritten = rewrite_hex_literals(input);
+		if (!rewritten)
+		{
+			return std::nullopt;
+		}
+		nlohmann::json j =
+		  nlohmann::json::parse(*rewritten, nullptr, /*allow_exceptions*/ false);
+		if (j.is_discarded() || !j.is_object())
+		{
+			return std::nullopt;
+		}
+		if (j.contains("devices"))
+		{
+			for (auto &device : j["devices"])
+			{
+				if (device.contains("end"))
+				{
+					device["length"] = device["end"].get<uint64_t>() -
+					                   device["start"].get<uint64_t>();
+					device.erase("end");
+				}
+			}
+		}
+		return j;
+	}
+} // namespace
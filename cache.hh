@@ -0,0 +1,178 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "sha256.hh"
+
+namespace
+{
+	/**
+	 * The version of the result cache.  This is part of every key, so
+	 * changing it invalidates all existing entries.  It must be incremented
+	 * whenever a change to `cheriot-audit` may change the result of a query
+	 * without changing any of its inputs, for example a change to a native
+	 * built-in function.
+	 */
+	constexpr std::string_view ResultCacheVersion = "cheriot-audit-cache-2";
+
+	/**
+	 * Helper for building a cache key from a sequence of fields.  Each field
+	 * is prefixed with its length so that different sequences of fields
+	 * never produce the same key.
+	 */
+	class CacheKeyBuilder
+	{
+		/// The hash of the fields so far.
+		SHA256 hash;
+
+		/// Add the length of the next field to the hash.
+		void add_length(uint64_t length)
+		{
+			uint8_t bytes[8];
+			for (size_t i = 0; i < sizeof(bytes); i++)
+			{
+				bytes[i] = (length >> (i * 8)) & 0xff;
+			}
+			hash.update(bytes);
+		}
+
+		public:
+		CacheKeyBuilder()
+		{
+			add(ResultCacheVersion);
+		}
+
+		/**
+		 * Add a string field.
+		 */
+		void add(std::string_view field)
+		{
+			add_length(field.size());
+			hash.update({reinterpret_cast<const uint8_t *>(field.data()),
+			             field.size()});
+		}
+
+		/**
+		 * Add the contents of a file as a field.  The file is hashed
+		 * without being parsed.  Returns false if the file cannot be read.
+		 */
+		bool add_file(const std::filesystem::path &path)
+		{
+			std::error_code error;
+			auto            size = std::filesystem::file_size(path, error);
+			std::ifstream   stream(path, std::ios::binary);
+			if (error || !stream)
+			{
+				return false;
+			}
+			add_length(size);
+			std::vector<char> buffer(1 << 20);
+			while (stream)
+			{
+				stream.read(buffer.data(), buffer.size());
+				hash.update({reinterpret_cast<const uint8_t *>(buffer.data()),
+				             size_t(stream.gcount())});
+			}
+			return stream.eof();
+		}
+
+		/**
+		 * Returns the key, as a hex string.  No more fields may be added
+		 * afterwards.
+		 */
+		std::string finish()
+		{
+			return hash.hex_digest();
+		}
+	};
+
+	/**
+	 * A persistent cache of query results.  Each result is stored in its
+	 * own file in the cache directory, named for the hash of the key of the
+	 * inputs (the firmware report, board, modules, and so on) and the query
+	 * text.  Entries are written to a temporary file and then renamed, so
+	 * concurrent runs sharing a cache directory never see partial entries.
+	 */
+	class ResultCache
+	{
+		/// The directory containing the cache entries.
+		std::filesystem::path directory;
+		/// The key for everything except the query text.
+		std::string inputsKey;
+
+		/// Returns the path of the entry for `query`.
+		[[nodiscard]] std::filesystem::path
+		entry_path(std::string_view query) const
+		{
+			CacheKeyBuilder key;
+			key.add(inputsKey);
+			key.add(query);
+			return directory / (key.finish() + ".result");
+		}
+
+		public:
+		/**
+		 * Open the cache in `directory`, creating it if necessary, for
+		 * queries on the inputs with the key `inputsKey`.
+		 */
+		ResultCache(std::filesystem::path directory, std::string inputsKey)
+		  : directory(std::move(directory)), inputsKey(std::move(inputsKey))
+		{
+			std::error_code error;
+			std::filesystem::create_directories(this->directory, error);
+		}
+
+		/**
+		 * Returns the cached result for `query`, if there is one.
+		 */
+		[[nodiscard]] std::optional<std::string>
+		lookup(std::string_view query) const
+		{
+			std::ifstream stream(entry_path(query), std::ios::binary);
+			if (!stream)
+			{
+				return std::nullopt;
+			}
+			return std::string(std::istreambuf_iterator<char>{stream}, {});
+		}
+
+		/**
+		 * Store `result` as the result for `query`.  Failures are ignored,
+		 * because the cache is only an optimisation.
+		 */
+		void store(std::string_view query, const std::string &result) const
+		{
+			auto path      = entry_path(query);
+			auto temporary = path;
+			temporary += "." + std::to_string(getpid()) + "." +
+			             std::to_string(std::hash<std::thread::id>{}(
+			               std::this_thread::get_id())) +
+			             ".tmp";
+			{
+				std::ofstream stream(temporary, std::ios::binary);
+				stream << result;
+				if (!stream.good())
+				{
+					return;
+				}
+			}
+			std::error_code error;
+			std::filesystem::rename(temporary, path, error);
+			if (error)
+			{
+				std::filesystem::remove(temporary, error);
+			}
+		}
+	};
+} // namespace
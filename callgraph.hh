@@ -0,0 +1,357 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "json_field.hh"
+
+namespace
+{
+	/**
+	 * The call graph of a firmware image.  Each compartment or library is a
+	 * node, and there is an edge from a caller to a callee if the caller
+	 * imports a function that the callee exports.  This includes both
+	 * cross-compartment calls and library calls.
+	 *
+	 * The graph is built when a firmware report is loaded and is immutable
+	 * after that, except for the cache of reachable sets, which is protected
+	 * by a lock so that the graph can be shared between interpreters on
+	 * different threads.
+	 */
+	class CallGraph
+	{
+		/// The names of the nodes, in sorted order.
+		std::vector<std::string> names;
+		/// Map from names to node numbers.
+		std::unordered_map<std::string, size_t> ids;
+		/// The callees of each node, sorted and without duplicates.
+		std::vector<std::vector<size_t>> edges;
+		/**
+		 * The strongly connected components, in reverse topological order
+		 * (every component's callees are in earlier components).
+		 */
+		std::vector<std::vector<size_t>> components;
+
+		/// Lock protecting `reachableCache`.
+		mutable std::mutex lock;
+		/// Cache of the nodes reachable from each node that has been queried.
+		mutable std::unordered_map<size_t, std::vector<std::string>>
+		  reachableCache;
+
+		/**
+		 * Returns true if any of the inputs of a compartment or library
+		 * came from `filename`.
+		 */
+		static bool includes_file(const nlohmann::json &compartment,
+		                          const std::string    &filename)
+		{
+			for (auto section : {"code", "data"})
+			{
+				auto it = compartment.find(section);
+				if ((it == compartment.end()) || !it->contains("inputs"))
+				{
+					continue;
+				}
+				for (auto &input : (*it)["inputs"])
+				{
+					if (string_field(input, "file") == filename)
+					{
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		/**
+		 * Compute the strongly connected components with Tarjan's algorithm.
+		 * This uses an explicit stack so that long call chains in large
+		 * images do not overflow the native stack.
+		 */
+		void find_components()
+		{
+			constexpr size_t    Unvisited = SIZE_MAX;
+			std::vector<size_t> index(names.size(), Unvisited);
+			std::vector<size_t> lowLink(names.size());
+			std::vector<bool>   onStack(names.size());
+			std::vector<size_t> stack;
+			size_t              nextIndex = 0;
+			// Work list of (node, next edge to visit) pairs.
+			std::vector<std::pair<size_t, size_t>> work;
+			for (size_t root = 0; root < names.size(); root++)
+			{
+				if (index[root] != Unvisited)
+				{
+					continue;
+				}
+				work.emplace_back(root, 0);
+				while (!work.empty())
+				{
+					auto &[node, edge] = work.back();
+					if (edge == 0)
+					{
+						index[node] = lowLink[node] = nextIndex++;
+						stack.push_back(node);
+						onStack[node] = true;
+					}
+					if (edge < edges[node].size())
+					{
+						size_t callee = edges[node][edge++];
+						if (index[callee] == Unvisited)
+						{
+							work.emplace_back(callee, 0);
+						}
+						else if (onStack[callee])
+						{
+							lowLink[node] =
+							  std::min(lowLink[node], index[callee]);
+						}
+						continue;
+					}
+					size_t finished = node;
+					work.pop_back();
+					if (!work.empty())
+					{
+						size_t parent = work.back().first;
+						lowLink[parent] =
+						  std::min(lowLink[parent], lowLink[finished]);
+					}
+					if (lowLink[finished] != index[finished])
+					{
+						continue;
+					}
+					std::vector<size_t> component;
+					size_t              member;
+					do
+					{
+						member = stack.back();
+						stack.pop_back();
+						onStack[member] = false;
+						component.push_back(member);
+					} while (member != finished);
+					std::sort(component.begin(), component.end());
+					components.push_back(std::move(component));
+				}
+			}
+		}
+
+		public:
+		/**
+		 * Build the call graph for a firmware report.
+		 */
+		explicit CallGraph(const nlohmann::json &report)
+		{
+			if (!report.contains("compartments"))
+			{
+				return;
+			}
+			auto &compartments = report["compartments"];
+			for (auto &[name, compartment] : compartments.items())
+			{
+				ids.emplace(name, names.size());
+				names.push_back(name);
+			}
+			edges.resize(names.size());
+			// Map from function export symbols to the nodes that export them.
+			std::unordered_map<std::string, std::vector<size_t>> exporters;
+			for (auto &[name, compartment] : compartments.items())
+			{
+				if (!compartment.contains("exports"))
+				{
+					continue;
+				}
+				for (auto &entry : compartment["exports"])
+				{
+					auto symbol = string_field(entry, "export_symbol");
+					if ((string_field(entry, "kind") == "Function") &&
+					    !symbol.empty())
+					{
+						exporters[std::string(symbol)].push_back(ids[name]);
+					}
+				}
+			}
+			for (auto &[name, compartment] : compartments.items())
+			{
+				if (!compartment.contains("imports"))
+				{
+					continue;
+				}
+				auto &callees = edges[ids[name]];
+				for (auto &entry : compartment["imports"])
+				{
+					auto it = exporters.find(
+					  std::string(string_field(entry, "export_symbol")));
+					if (it == exporters.end())
+					{
+						continue;
+					}
+					// If more than one library exports the same symbol, use
+					// the one that was linked from the file that provides
+					// the import.
+					auto candidates = it->second;
+					if (candidates.size() > 1)
+					{
+						std::string providedBy{string_field(entry, "provided_by")};
+						std::erase_if(candidates, [&](size_t callee) {
+							return !includes_file(compartments[names[callee]],
+							                      providedBy);
+						});
+						if (candidates.empty())
+						{
+							candidates = it->second;
+						}
+					}
+					callees.insert(
+					  callees.end(), candidates.begin(), candidates.end());
+				}
+				std::sort(callees.begin(), callees.end());
+				callees.erase(std::unique(callees.begin(), callees.end()),
+				              callees.end());
+			}
+			find_components();
+		}
+
+		/**
+		 * Returns the node number for a name, if it is in the graph.
+		 */
+		[[nodiscard]] std::optional<size_t> find(const std::string &name) const
+		{
+			if (auto it = ids.find(name); it != ids.end())
+			{
+				return it->second;
+			}
+			return std::nullopt;
+		}
+
+		/**
+		 * Returns the sorted names of every node that is reachable from
+		 * `from` by following one or more calls.  `from` is included only if
+		 * it is part of a cycle.  Results are cached.
+		 */
+		[[nodiscard]] std::vector<std::string> reachable(size_t from) const
+		{
+			{
+				std::unique_lock guard{lock};
+				if (auto it = reachableCache.find(from);
+				    it != reachableCache.end())
+				{
+					return it->second;
+				}
+			}
+			std::vector<bool>   visited(names.size());
+			std::vector<size_t> work = edges[from];
+			while (!work.empty())
+			{
+				size_t node = work.back();
+				work.pop_back();
+				if (visited[node])
+				{
+					continue;
+				}
+				visited[node] = true;
+				work.insert(work.end(), edges[node].begin(), edges[node].end());
+			}
+			std::vector<std::string> result;
+			for (size_t i = 0; i < names.size(); i++)
+			{
+				if (visited[i])
+				{
+					result.push_back(names[i]);
+				}
+			}
+			std::unique_lock guard{lock};
+			reachableCache.emplace(from, result);
+			return result;
+		}
+
+		/**
+		 * Returns the names of the nodes on a shortest call path from `from`
+		 * to `to`, including both ends, or an empty optional if `to` is not
+		 * reachable from `from`.
+		 */
+		[[nodiscard]] std::optional<std::vector<std::string>>
+		path(size_t from, size_t to) const
+		{
+			constexpr size_t    NoParent = SIZE_MAX;
+			std::vector<size_t> parent(names.size(), NoParent);
+			std::vector<size_t> frontier{from};
+			bool                found = false;
+			// Breadth-first search, so the first time that `to` is reached is
+			// along a shortest path.  The search starts from the callees of
+			// `from` so that a path from a node to itself is a cycle.
+			for (size_t i = 0; (i < frontier.size()) && !found; i++)
+			{
+				for (size_t callee : edges[frontier[i]])
+				{
+					if (parent[callee] != NoParent)
+					{
+						continue;
+					}
+					parent[callee] = frontier[i];
+					if (callee == to)
+					{
+						found = true;
+						break;
+					}
+					frontier.push_back(callee);
+				}
+			}
+			if (!found)
+			{
+				return std::nullopt;
+			}
+			std::vector<std::string> result{names[to]};
+			for (size_t node = parent[to]; node != from; node = parent[node])
+			{
+				result.push_back(names[node]);
+			}
+			result.push_back(names[from]);
+			std::reverse(result.begin(), result.end());
+			return result;
+		}
+
+		/**
+		 * Returns the graph as JSON, for exposing to Rego as
+		 * `data.callgraph`.  This contains `edges`, mapping each compartment
+		 * or library to the sorted array of compartments and libraries that
+		 * it calls, and `sccs`, an array of the strongly connected
+		 * components that contain more than one node, each as a sorted array
+		 * of names.
+		 */
+		[[nodiscard]] nlohmann::json to_json() const
+		{
+			nlohmann::json edgesJSON = nlohmann::json::object();
+			for (size_t i = 0; i < names.size(); i++)
+			{
+				auto &callees = edgesJSON[names[i]];
+				callees       = nlohmann::json::array();
+				for (size_t callee : edges[i])
+				{
+					callees.push_back(names[callee]);
+				}
+			}
+			std::set<std::vector<std::string>> sccs;
+			for (auto &component : components)
+			{
+				if (component.size() < 2)
+				{
+					continue;
+				}
+				std::vector<std::string> members;
+				for (size_t member : component)
+				{
+					members.push_back(names[member]);
+				}
+				sccs.insert(std::move(members));
+			}
+			return {{"edges", edgesJSON}, {"sccs", sccs}};
+		}
+	};
+} // namespace
@@ -23,14 +23,12 @@ namespace
 		}
 
 
-		export_for_import(importEntry) = entry if { 
+		export_for_import(importEntry) = entry if {
 			some possibleEntries
-			some allExports
-			allExports = {export | input.compartments[_].exports[_] = export}
-			possibleEntries = [{"compartment": compartment, "entry": entry} | entry = input.compartments[compartment].exports[_]; export_matches_import(entry, importEntry)]
+			possibleEntries = data.index.exporters[importEntry.export_symbol]
 			count(possibleEntries) == 1
 			compartment_includes_file(input.compartments[possibleEntries[0].compartment], importEntry.provided_by)
-			entry := possibleEntries[0].entry
+			entry := possibleEntries[0].export
 		}
 
 		import_is_library_call(a) if { a.kind = "LibraryFunction" }
@@ -70,7 +68,10 @@ namespace
 		}
 
 		compartments_with_mmio_import(device) = compartments if {
-			compartments = [i | c = input.compartments[i]; compartment_imports_device(c, device)]
+			# MMIO imports are indexed natively by range when the report is
+			# loaded.  A device without a start and length is imported by no
+			# compartments.
+			compartments = [c | c = mmio_importers(device.start, device.length)[_]]
 		}
 
 		shared_object_imports_for_compartment(compartment) = entry if {
@@ -99,46 +100,34 @@ namespace
 			some compartment
 			compartment = input.compartments[compartmentName]
 			some exports
-			exports = [e | e = compartment.exports[_]; regex.match(symbol, export_entry_demangle(compartmentName, e.export_symbol))]
+			# Export names are demangled natively when the report is loaded
+			# and the pattern is compiled once and cached.
+			names = object.get(data.demangled, compartmentName, {})
+			matches = {m.export_symbol | m = export_table_match(symbol, {compartmentName: names})[_]}
+			exports = [e | e = compartment.exports[_]; matches[e.export_symbol]]
 			count(exports) == 1
 			export := exports[0]
 		}
 
 		compartments_calling_export(export) = compartments if {
-			compartments = [c | i = input.compartments[c].imports[_]; export_matches_import(i, export)]
+			compartments = object.get(data.index.importers, export.export_symbol, [])
 		}
 
 		compartments_calling_export_matching(compartmentName, export) = compartments if {
 			compartments = compartments_calling_export(compartment_export_matching_symbol(compartmentName, export))
 		}
 
-		# Helper that builds a map from symbol names to compartments.  This is
-		# to avoid some O(n^2) lookups.  Or would, if rego-cpp didn't recompute
-		# this every evaluation.
-		#entry_point_map := { entry.export_symbol : compartment | entry = input.compartments[compartment].exports[_] ; entry.kind = "Function"}
-
 		compartment_exports_function(callee, importEntry) if {
-			#entry_point_map[importEntry.export_symbol] == callee
 			some possibleEntries
-			possibleEntries = [entry | entry = input.compartments[callee].exports[_]; export_matches_import(entry, importEntry)]
+			possibleEntries = [e | e = data.index.exporters[importEntry.export_symbol][_]; e.compartment == callee]
 			count(possibleEntries) == 1
 			compartment_includes_file(input.compartments[callee], importEntry.provided_by)
 		}
 
-		# Helper to work around rego-cpp#117
-		check_export(exports, importEntry, compartment) if {
-			exports[importEntry.export_symbol] == compartment
-		}
-
 		compartments_calling(callee) = compartments if {
-			# Create a reverse map that maps from exported symbols to
-			# compartments.  This avoids some O(n^2) lookups.  It would be nice
-			# to cache this globally but rego-cpp doesn't support that yet.
-			# This reduces the time for this query on the test suite from over
-			# 6s to under 0.5s for me.
-			some entry_point_map
-			entry_point_map = { entry.export_symbol : compartment | entry = input.compartments[compartment].exports[_] ; entry.kind = "Function"}
-			compartments = {c | i = input.compartments[c].imports[_]; check_export(entry_point_map, i, callee)}
+			# The reverse map from callees to callers is built natively when
+			# the firmware report is loaded.
+			compartments = {c | c = object.get(data.index.callers, callee, [])[_]}
 		}
 
 
@@ -0,0 +1,189 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "string_hash.hh"
+
+namespace
+{
+	/**
+	 * Strip the prefix from an export symbol, leaving the mangled name of the
+	 * function.  Library exports start with `__library_export_libcalls`,
+	 * compartment exports start with `__export_` followed by the name of the
+	 * compartment.  Returns an empty optional if the symbol does not have the
+	 * expected prefix.
+	 */
+	std::optional<std::string_view>
+	mangled_export_name(std::string_view symbol,
+	                    std::string_view compartmentName)
+	{
+		const std::string_view LibraryExportPrefix =
+		  "__library_export_libcalls";
+		const std::string_view ExportPrefix = "__export_";
+		if (symbol.starts_with(LibraryExportPrefix))
+		{
+			symbol.remove_prefix(LibraryExportPrefix.size());
+		}
+		else
+		{
+			if (!symbol.starts_with(ExportPrefix))
+			{
+				return std::nullopt;
+			}
+			symbol.remove_prefix(ExportPrefix.size());
+			if (!symbol.starts_with(compartmentName))
+			{
+				return std::nullopt;
+			}
+			symbol.remove_prefix(compartmentName.size());
+		}
+		if (!symbol.starts_with("_"))
+		{
+			return std::nullopt;
+		}
+		symbol.remove_prefix(1);
+		return symbol;
+	}
+
+	/**
+	 * Demangle a C++ symbol name.  Returns an empty optional if the name is
+	 * not a valid mangled name.
+	 */
+	std::optional<std::string> demangle(const std::string &mangled)
+	{
+		// The way that rego-cpp exposes snmalloc can cause the realloc in
+		// `__cxa_demangle` to crash, so give it a buffer that is large enough
+		// that it never needs to grow.  The buffer is reused for every name
+		// demangled on this thread and is only replaced when a longer name is
+		// seen.
+		struct Buffer
+		{
+			char  *data = nullptr;
+			size_t size = 0;
+
+			~Buffer()
+			{
+				free(data);
+			}
+		};
+		thread_local Buffer buffer;
+		if (buffer.size < mangled.size() * 8)
+		{
+			free(buffer.data);
+			buffer.size = std::max<size_t>(mangled.size() * 8, 256);
+			buffer.data = static_cast<char *>(malloc(buffer.size));
+		}
+		int   error;
+		char *demangled = abi::__cxa_demangle(
+		  mangled.c_str(), buffer.data, &buffer.size, &error);
+		if ((demangled == nullptr) || (error != 0))
+		{
+			return std::nullopt;
+		}
+		buffer.data = demangled;
+		return std::string(demangled);
+	}
+
+	/**
+	 * Process-wide memo table from mangled names (with the export prefix
+	 * removed) to demangled names.  This is populated with every export in a
+	 * firmware report when the report is loaded, so the built-in functions
+	 * that demangle exports are usually a lookup.  Names that fail to
+	 * demangle are cached as empty optionals.  Entries are never removed, so
+	 * views of cached names remain valid for the lifetime of the program.
+	 */
+	class DemangleCache
+	{
+		std::shared_mutex lock;
+		std::unordered_map<std::string,
+		                   std::optional<std::string>,
+		                   StringViewHash,
+		                   std::equal_to<>>
+		  names;
+
+		public:
+		/**
+		 * Returns the demangled name for an export symbol from the named
+		 * compartment or library, or an empty optional if the symbol is not
+		 * a valid export symbol.  The result is a view of the cached copy,
+		 * so a cache hit does not allocate.
+		 */
+		std::optional<std::string_view> get(std::string_view symbol,
+		                                    std::string_view compartmentName)
+		{
+			auto mangledName = mangled_export_name(symbol, compartmentName);
+			if (!mangledName)
+			{
+				return std::nullopt;
+			}
+			{
+				std::shared_lock guard{lock};
+				if (auto it = names.find(*mangledName); it != names.end())
+				{
+					return it->second;
+				}
+			}
+			std::string      mangled{*mangledName};
+			auto             demangled = demangle(mangled);
+			std::unique_lock guard{lock};
+			auto [it, inserted] = names.emplace(std::move(mangled), demangled);
+			return it->second;
+		}
+
+		/**
+		 * Demangle every export in a firmware report, adding the results to
+		 * the cache.  Returns the demangled names as a JSON object mapping
+		 * each compartment or library name to an object that maps its export
+		 * symbols to their demangled names.  Symbols that cannot be demangled
+		 * are omitted.
+		 */
+		nlohmann::json insert_all(const nlohmann::json &report)
+		{
+			nlohmann::json table = nlohmann::json::object();
+			if (!report.contains("compartments"))
+			{
+				return table;
+			}
+			for (auto &[name, compartment] : report["compartments"].items())
+			{
+				auto &exports = table[name];
+				exports       = nlohmann::json::object();
+				if (!compartment.contains("exports"))
+				{
+					continue;
+				}
+				for (auto &entry : compartment["exports"])
+				{
+					if (!entry.contains("export_symbol") ||
+					    !entry["export_symbol"].is_string())
+					{
+						continue;
+					}
+					auto &symbol =
+					  entry["export_symbol"].get_ref<const std::string &>();
+					if (auto demangled = get(symbol, name))
+					{
+						exports[symbol] = *demangled;
+					}
+				}
+			}
+			return table;
+		}
+	};
+
+	/**
+	 * The cache used by the built-in functions.
+	 */
+	DemangleCache demangledNames;
+} // namespace
@@ -0,0 +1,222 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "json_field.hh"
+
+namespace
+{
+	/**
+	 * Index of the memory-mapped devices on the board and of the MMIO imports
+	 * in a firmware image.  Devices are kept sorted by start address so that
+	 * lookups by address and overlap queries are logarithmic in the number
+	 * of devices, and MMIO imports are indexed by their exact range.
+	 */
+	class DeviceIndex
+	{
+		/**
+		 * A device on the board.
+		 */
+		struct Device
+		{
+			uint64_t    start;
+			uint64_t    end;
+			std::string name;
+		};
+
+		/// The devices, sorted by start address.
+		std::vector<Device> devices;
+		/**
+		 * The largest end address of any device up to and including each
+		 * position in `devices`.  Used to stop searching for overlapping
+		 * devices early.
+		 */
+		std::vector<uint64_t> maxEnd;
+		/// The compartments that import each MMIO range, by (start, length).
+		std::map<std::pair<uint64_t, uint64_t>, std::set<std::string>>
+		  importers;
+
+		public:
+		/**
+		 * Build the index from a board description, with device ends
+		 * already converted to lengths, and a firmware report.
+		 */
+		DeviceIndex(const nlohmann::json &board, const nlohmann::json &report)
+		{
+			if (board.contains("devices") && board["devices"].is_object())
+			{
+				for (auto &[name, device] : board["devices"].items())
+				{
+					if (!device.contains("start") || !device.contains("length") ||
+					    !device["start"].is_number_unsigned() ||
+					    !device["length"].is_number_unsigned())
+					{
+						continue;
+					}
+					uint64_t start = device["start"].get<uint64_t>();
+					devices.push_back(
+					  {start, start + device["length"].get<uint64_t>(), name});
+				}
+			}
+			std::sort(devices.begin(), devices.end(), [](auto &a, auto &b) {
+				return a.start < b.start;
+			});
+			uint64_t end = 0;
+			for (auto &device : devices)
+			{
+				end = std::max(end, device.end);
+				maxEnd.push_back(end);
+			}
+			if (!report.contains("compartments"))
+			{
+				return;
+			}
+			for (auto &[name, compartment] : report["compartments"].items())
+			{
+				if (!compartment.contains("imports"))
+				{
+					continue;
+				}
+				for (auto &entry : compartment["imports"])
+				{
+					if ((string_field(entry, "kind") == "MMIO") &&
+					    entry.contains("start") && entry.contains("length") &&
+					    entry["start"].is_number_unsigned() &&
+					    entry["length"].is_number_unsigned())
+					{
+						importers[{entry["start"].get<uint64_t>(),
+						           entry["length"].get<uint64_t>()}]
+						  .insert(name);
+					}
+				}
+			}
+		}
+
+		/**
+		 * Returns the name of the device that contains `address`.  If
+		 * devices overlap, the one that starts last is returned.
+		 */
+		[[nodiscard]] std::optional<std::string>
+		device_at(uint64_t address) const
+		{
+			auto matches = overlapping(address, 1);
+			if (matches.empty())
+			{
+				return std::nullopt;
+			}
+			return matches.back().name;
+		}
+
+		/**
+		 * Returns the devices that overlap the range of `length` bytes
+		 * starting at `start`, in order of their start addresses.
+		 */
+		[[nodiscard]] std::vector<Device> overlapping(uint64_t start,
+		                                              uint64_t length) const
+		{
+			std::vector<Device> result;
+			uint64_t            end = start + length;
+			// Find the first device that starts at or after the end of the
+			// range and then walk backwards until no earlier device can
+			// reach the start of the range.
+			auto first = std::lower_bound(
+			  devices.begin(), devices.end(), end, [](auto &device, auto end) {
+				  return device.start < end;
+			  });
+			for (size_t i = first - devices.begin(); i > 0; i--)
+			{
+				if (maxEnd[i - 1] <= start)
+				{
+					break;
+				}
+				if (devices[i - 1].end > start)
+				{
+					result.push_back(devices[i - 1]);
+				}
+			}
+			std::reverse(result.begin(), result.end());
+			return result;
+		}
+
+		/**
+		 * Returns the sorted names of the compartments that import exactly
+		 * the range of `length` bytes starting at `start`.
+		 */
+		[[nodiscard]] std::vector<std::string> importers_of(uint64_t start,
+		                                                    uint64_t length) const
+		{
+			auto it = importers.find({start, length});
+			if (it == importers.end())
+			{
+				return {};
+			}
+			return {it->second.begin(), it->second.end()};
+		}
+
+		/**
+		 * Returns the index as JSON, for exposing to Rego as `data.devices`.
+		 * This contains `importers`, mapping each device name to the sorted
+		 * array of compartments that import exactly that device, and
+		 * `mismatched`, an array describing every MMIO import that overlaps
+		 * one or more devices without exactly matching any of them, and
+		 * `unmatched`, an array describing every MMIO import that overlaps
+		 * no device.
+		 */
+		[[nodiscard]] nlohmann::json to_json() const
+		{
+			nlohmann::json importersJSON = nlohmann::json::object();
+			for (auto &device : devices)
+			{
+				importersJSON[device.name] =
+				  importers_of(device.start, device.end - device.start);
+			}
+			nlohmann::json mismatched = nlohmann::json::array();
+			nlohmann::json unmatched  = nlohmann::json::array();
+			for (auto &[range, compartments] : importers)
+			{
+				auto [start, length] = range;
+				auto matches         = overlapping(start, length);
+				if (matches.empty())
+				{
+					for (auto &compartment : compartments)
+					{
+						unmatched.push_back({{"compartment", compartment},
+						                     {"start", start},
+						                     {"length", length}});
+					}
+					continue;
+				}
+				if (std::any_of(matches.begin(), matches.end(), [&](auto &d) {
+					    return (d.start == start) && (d.end == start + length);
+				    }))
+				{
+					continue;
+				}
+				nlohmann::json names = nlohmann::json::array();
+				for (auto &device : matches)
+				{
+					names.push_back(device.name);
+				}
+				for (auto &compartment : compartments)
+				{
+					mismatched.push_back({{"compartment", compartment},
+					                      {"start", start},
+					                      {"length", length},
+					                      {"devices", names}});
+				}
+			}
+			return {{"importers", importersJSON},
+			        {"mismatched", mismatched},
+			        {"unmatched", unmatched}};
+		}
+	};
+} // namespace
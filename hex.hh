@@ -0,0 +1,165 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <nlohmann/json.hpp>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "json_field.hh"
+#include "string_hash.hh"
+
+namespace
+{
+	/**
+	 * Table mapping ASCII characters to the value of the hex digit that they
+	 * represent.  Characters that are not hex digits map to 0xff, so any
+	 * invalid digit can be detected by checking the high bits of the bitwise
+	 * OR of all of the decoded values.
+	 */
+	constexpr std::array<uint8_t, 256> HexDigitValues = []() {
+		std::array<uint8_t, 256> table{};
+		table.fill(0xff);
+		for (int i = 0; i < 10; i++)
+		{
+			table['0' + i] = i;
+		}
+		for (int i = 0; i < 6; i++)
+		{
+			table['a' + i] = 10 + i;
+			table['A' + i] = 10 + i;
+		}
+		return table;
+	}();
+
+	/**
+	 * Decode one group of eight hex digits into four bytes.  This is
+	 * branch-free over the group so that the compiler can unroll and
+	 * vectorise it.  Returns false if any of the characters is not a hex
+	 * digit.
+	 */
+	inline bool decode_hex_group(const char *in, uint8_t *out)
+	{
+		uint8_t invalid = 0;
+		for (size_t i = 0; i < 4; i++)
+		{
+			uint8_t high = HexDigitValues[static_cast<uint8_t>(in[i * 2])];
+			uint8_t low  = HexDigitValues[static_cast<uint8_t>(in[i * 2 + 1])];
+			invalid |= high | low;
+			out[i] = (high << 4) | low;
+		}
+		return (invalid & 0xf0) == 0;
+	}
+
+	/**
+	 * Decode the hex strings emitted for static sealed objects.  These are
+	 * written as sequences of bytes, with a space between each four bytes.
+	 * The result is written to `result`, which is cleared first.  Returns
+	 * false (and leaves `result` empty) if the string is not valid.
+	 */
+	bool decode_hex(std::string_view hexString, std::vector<uint8_t> &result)
+	{
+		result.clear();
+		result.reserve((hexString.size() + 1) / 9 * 4);
+		while (hexString.size() >= 8)
+		{
+			uint8_t group[4];
+			if (!decode_hex_group(hexString.data(), group))
+			{
+				result.clear();
+				return false;
+			}
+			result.insert(result.end(), group, group + 4);
+			hexString = hexString.substr(8);
+			if (hexString.size() > 0 && hexString[0] == ' ')
+			{
+				hexString = hexString.substr(1);
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * The decoded contents of the static sealed objects in one firmware
+	 * image, keyed by the hex string from the firmware report.  This is
+	 * built when a report is loaded, so that the built-in functions that
+	 * extract fields from sealed objects do not need to decode the whole
+	 * object each time that they are called.  It belongs to the image and
+	 * is freed with it, and it is immutable once built and so can be shared
+	 * between interpreters on different threads without locking.
+	 */
+	class SealedObjectContents
+	{
+		std::unordered_map<std::string,
+		                   std::vector<uint8_t>,
+		                   StringViewHash,
+		                   std::equal_to<>>
+		  decoded;
+
+		public:
+		SealedObjectContents() = default;
+
+		/**
+		 * Decode the contents of every static sealed object imported by any
+		 * compartment in a firmware report.
+		 */
+		explicit SealedObjectContents(const nlohmann::json &report)
+		{
+			if (!report.contains("compartments"))
+			{
+				return;
+			}
+			for (auto &[name, compartment] : report["compartments"].items())
+			{
+				if (!compartment.contains("imports"))
+				{
+					continue;
+				}
+				for (auto &entry : compartment["imports"])
+				{
+					if ((string_field(entry, "kind") != "SealedObject") ||
+					    !entry.contains("contents") ||
+					    !entry["contents"].is_string())
+					{
+						continue;
+					}
+					auto &hexString =
+					  entry["contents"].get_ref<const std::string &>();
+					if (decoded.contains(hexString))
+					{
+						continue;
+					}
+					std::vector<uint8_t> bytes;
+					decode_hex(hexString, bytes);
+					decoded.emplace(hexString, std::move(bytes));
+				}
+			}
+		}
+
+		/**
+		 * Returns the decoded bytes for `hexString`.  If the string is in the
+		 * table then this returns a view of the decoded copy, otherwise it
+		 * decodes into `scratch` and returns a view of that.  Invalid strings
+		 * decode as an empty sequence.  This does not allocate unless the
+		 * string is not in the table and is larger than any that `scratch`
+		 * has previously held.
+		 */
+		std::span<const uint8_t> get(std::string_view      hexString,
+		                             std::vector<uint8_t> &scratch) const
+		{
+			if (auto it = decoded.find(hexString); it != decoded.end())
+			{
+				return it->second;
+			}
+			decode_hex(hexString, scratch);
+			return scratch;
+		}
+	};
+} // namespace
@@ -0,0 +1,179 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+	/**
+	 * Compare a firmware report against a baseline and return the parts that
+	 * differ.  Each compartment or library is compared separately and is
+	 * reported as `compartments.name` if it was added, removed, or changed.
+	 * Compartment entries contain the `sha256` of every input and output, as
+	 * well as the import and export tables, so a compartment is unchanged
+	 * only if it was built from the same inputs and links to the same
+	 * things.  Every other top-level section of the report (for example
+	 * `threads`, `sharedObjects`, and `core`) is reported by name if it
+	 * differs.  The `final_hash` and `file` fields are ignored, because they
+	 * change whenever anything does.
+	 */
+	std::set<std::string> changed_sections(const nlohmann::json &baseline,
+	                                       const nlohmann::json &report)
+	{
+		std::set<std::string> changes;
+		auto                  sectionNames = [](const nlohmann::json &j) {
+			std::set<std::string> names;
+			for (auto &[name, value] : j.items())
+			{
+				names.insert(name);
+			}
+			return names;
+		};
+		auto empty     = nlohmann::json::object();
+		auto getObject = [&](const nlohmann::json &j,
+		                     const std::string    &name) -> const auto & {
+			auto it = j.find(name);
+			return ((it != j.end()) && it->is_object()) ? *it : empty;
+		};
+		std::set<std::string> sections = sectionNames(baseline);
+		sections.merge(sectionNames(report));
+		for (auto &section : sections)
+		{
+			if ((section == "final_hash") || (section == "file"))
+			{
+				continue;
+			}
+			if (section == "compartments")
+			{
+				auto &before = getObject(baseline, section);
+				auto &after  = getObject(report, section);
+				std::set<std::string> names = sectionNames(before);
+				names.merge(sectionNames(after));
+				for (auto &name : names)
+				{
+					if (!before.contains(name) || !after.contains(name) ||
+					    (before[name] != after[name]))
+					{
+						changes.insert("compartments." + name);
+					}
+				}
+				continue;
+			}
+			if (!baseline.contains(section) || !report.contains(section) ||
+			    (baseline[section] != report[section]))
+			{
+				changes.insert(section);
+			}
+		}
+		return changes;
+	}
+
+	/**
+	 * Returns true if a query that depends on the sections of the report
+	 * named in `dependencies` may be affected by `changes`.  A dependency
+	 * matches a change if either is a prefix of the other, so a query that
+	 * depends on `compartments` is affected by a change to any compartment
+	 * and a query that depends on `compartments.allocator` is affected only
+	 * by a change to the allocator.
+	 */
+	bool depends_on_changes(const std::vector<std::string> &dependencies,
+	                        const std::set<std::string>    &changes)
+	{
+		auto isPrefix = [](std::string_view prefix, std::string_view path) {
+			return path.starts_with(prefix) &&
+			       ((path.size() == prefix.size()) ||
+			        (path[prefix.size()] == '.'));
+		};
+		for (auto &dependency : dependencies)
+		{
+			for (auto &change : changes)
+			{
+				if (isPrefix(dependency, change) || isPrefix(change, dependency))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * The results of a previous run with `--query-file`.
+	 */
+	struct BaselineResults
+	{
+		/**
+		 * The key for the inputs other than the firmware report that the
+		 * results were produced with, or empty if they do not record one.
+		 */
+		std::string inputs;
+		/**
+		 * The key for the text of each query that declares its dependencies,
+		 * indexed by query name.
+		 */
+		std::map<std::string, std::string> queries;
+		/// The results, indexed by query name.
+		std::map<std::string, nlohmann::ordered_json> results;
+	};
+
+	/**
+	 * Read the results of a previous run with `--query-file`, one JSON object
+	 * per line.  A line with an `inputs` field gives the key for the inputs
+	 * other than the firmware report and, in its `queries` field, the key
+	 * for the text of each query that declares its dependencies.  Every
+	 * other line is a result.
+	 * Lines that are not objects with either an `inputs` or a `name` field
+	 * are ignored.  Returns an empty optional if the file cannot be read.
+	 */
+	std::optional<BaselineResults>
+	read_baseline_results(const std::filesystem::path &path)
+	{
+		std::ifstream stream(path);
+		if (!stream)
+		{
+			return std::nullopt;
+		}
+		BaselineResults baseline;
+		std::string     line;
+		while (std::getline(stream, line))
+		{
+			auto result = nlohmann::ordered_json::parse(
+			  line, nullptr, /*allow_exceptions*/ false);
+			if (result.is_discarded() || !result.is_object())
+			{
+				continue;
+			}
+			if (result.contains("inputs") && result["inputs"].is_string())
+			{
+				baseline.inputs = result["inputs"].get<std::string>();
+				if (result.contains("queries") && result["queries"].is_object())
+				{
+					for (auto &[name, key] : result["queries"].items())
+					{
+						if (key.is_string())
+						{
+							baseline.queries[name] = key.get<std::string>();
+						}
+					}
+				}
+				continue;
+			}
+			if (!result.contains("name") || !result["name"].is_string())
+			{
+				continue;
+			}
+			auto name = result["name"].get<std::string>();
+			baseline.results.emplace(std::move(name), std::move(result));
+		}
+		return baseline;
+	}
+} // namespace
@@ -0,0 +1,93 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <map>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <string>
+
+#include "json_field.hh"
+
+namespace
+{
+	/**
+	 * Build the index that is exposed to Rego as `data.index`.  This contains
+	 * reverse maps over the firmware report that would otherwise need to be
+	 * recomputed with O(n^2) joins every time a rule is evaluated:
+	 *
+	 *  - `exporters` maps each export symbol to an array of the
+	 *    `{ "compartment": name, "export": entry }` pairs that export it.
+	 *  - `importers` maps each export symbol to the array of compartments that
+	 *    import it, with one entry per import.
+	 *  - `callers` maps each compartment or library name to a sorted array of
+	 *    the compartments that import any of its exported functions.
+	 */
+	nlohmann::json build_index(const nlohmann::json &report)
+	{
+		nlohmann::json exporters = nlohmann::json::object();
+		nlohmann::json importers = nlohmann::json::object();
+		// Map from function export symbols to the compartments that export
+		// them.
+		std::map<std::string, std::set<std::string>> functionExporters;
+		std::map<std::string, std::set<std::string>> callers;
+		if (!report.contains("compartments"))
+		{
+			return {{"exporters", exporters},
+			        {"importers", importers},
+			        {"callers", nlohmann::json::object()}};
+		}
+		auto &compartments = report["compartments"];
+		for (auto &[name, compartment] : compartments.items())
+		{
+			if (!compartment.contains("exports"))
+			{
+				continue;
+			}
+			for (auto &entry : compartment["exports"])
+			{
+				if (!entry.contains("export_symbol") ||
+				    !entry["export_symbol"].is_string())
+				{
+					continue;
+				}
+				auto &symbol =
+				  entry["export_symbol"].get_ref<const std::string &>();
+				exporters[symbol].push_back(
+				  nlohmann::json{{"compartment", name}, {"export", entry}});
+				if (string_field(entry, "kind") == "Function")
+				{
+					functionExporters[symbol].insert(name);
+				}
+			}
+		}
+		for (auto &[name, compartment] : compartments.items())
+		{
+			if (!compartment.contains("imports"))
+			{
+				continue;
+			}
+			for (auto &entry : compartment["imports"])
+			{
+				if (!entry.contains("export_symbol") ||
+				    !entry["export_symbol"].is_string())
+				{
+					continue;
+				}
+				auto &symbol =
+				  entry["export_symbol"].get_ref<const std::string &>();
+				importers[symbol].push_back(name);
+				if (auto it = functionExporters.find(symbol);
+				    it != functionExporters.end())
+				{
+					for (auto &callee : it->second)
+					{
+						callers[callee].insert(name);
+					}
+				}
+			}
+		}
+		return {{"exporters", exporters},
+		        {"importers", importers},
+		        {"callers", callers}};
+	}
+} // namespace
@@ -0,0 +1,33 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+
+namespace
+{
+	/**
+	 * Returns the string field `name` of `object`, or an empty string if
+	 * `object` is not an object or the field is missing or not a string.
+	 * Unlike `nlohmann::json::value`, this never throws, so a malformed
+	 * firmware report is treated as if the field were absent rather than
+	 * terminating the process.
+	 */
+	std::string_view string_field(const nlohmann::json &object,
+	                              const char           *name)
+	{
+		if (!object.is_object())
+		{
+			return {};
+		}
+		auto it = object.find(name);
+		if ((it == object.end()) || !it->is_string())
+		{
+			return {};
+		}
+		return it->get_ref<const std::string &>();
+	}
+} // namespace
@@ -0,0 +1,260 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "string_hash.hh"
+
+namespace
+{
+	/**
+	 * A single field in a compiled sealed-object layout.
+	 */
+	struct SealedObjectField
+	{
+		/// The name of the field in the decoded object.
+		std::string name;
+		/// The offset of the field from the start of the object.
+		size_t offset;
+		/// The size of one element of the field, in bytes.
+		size_t width;
+		/// The number of elements if this is an array, zero otherwise.
+		size_t count;
+		/// Is this a signed integer?
+		bool isSigned;
+		/// Is this a fixed-size buffer containing a C string?
+		bool isString;
+
+		/**
+		 * The total number of bytes occupied by this field.
+		 */
+		[[nodiscard]] size_t size() const
+		{
+			return width * std::max<size_t>(count, 1);
+		}
+	};
+
+	using SealedObjectLayout = std::vector<SealedObjectField>;
+
+	/**
+	 * The largest object that a layout may describe.  CHERIoT has a 32-bit
+	 * address space, so no sealed object can be larger than this.  Bounding
+	 * every field by this means that offset and size arithmetic on fields in
+	 * a compiled layout cannot overflow.
+	 */
+	constexpr size_t MaxSealedObjectSize = 0xffff'ffff;
+
+	/**
+	 * Parse a number in a layout descriptor, which may be decimal or hex with
+	 * a 0x prefix.
+	 */
+	std::optional<size_t> parse_layout_number(std::string_view text)
+	{
+		int base = 10;
+		if (text.starts_with("0x"))
+		{
+			text = text.substr(2);
+			base = 16;
+		}
+		size_t value;
+		auto [end, error] =
+		  std::from_chars(text.data(), text.data() + text.size(), value, base);
+		if ((error != std::errc{}) || (end != text.data() + text.size()))
+		{
+			return std::nullopt;
+		}
+		return value;
+	}
+
+	/**
+	 * Compile a layout descriptor.  Descriptors are whitespace-separated
+	 * lists of fields, each written as `name:type`, optionally followed by
+	 * `[count]` to make the field an array and `@offset` to give an explicit
+	 * offset.  Fields without an explicit offset immediately follow the
+	 * previous field.  The types are `u8`, `u16`, `u32`, `i8`, `i16` and
+	 * `i32` for little-endian integers and `char`, which must be used as
+	 * `char[N]` and decodes a null-terminated string from an `N`-byte buffer.
+	 *
+	 * For example, `quota:u32 reserved:u32[5]` describes a 32-bit integer
+	 * followed by an array of five more.
+	 *
+	 * Returns an empty optional if the descriptor is not valid, including if
+	 * any field would extend beyond `MaxSealedObjectSize` bytes.
+	 */
+	std::optional<SealedObjectLayout>
+	compile_sealed_object_layout(std::string_view descriptor)
+	{
+		SealedObjectLayout layout;
+		size_t             nextOffset = 0;
+		auto               isSpace    = [](char c) {
+			return (c == ' ') || (c == '\t') || (c == '\n');
+		};
+		while (!descriptor.empty())
+		{
+			if (isSpace(descriptor.front()))
+			{
+				descriptor.remove_prefix(1);
+				continue;
+			}
+			size_t end = 0;
+			while ((end < descriptor.size()) && !isSpace(descriptor[end]))
+			{
+				end++;
+			}
+			std::string_view field = descriptor.substr(0, end);
+			descriptor.remove_prefix(end);
+
+			SealedObjectField result{};
+			size_t            colon = field.find(':');
+			if ((colon == 0) || (colon == std::string_view::npos))
+			{
+				return std::nullopt;
+			}
+			result.name = field.substr(0, colon);
+			field.remove_prefix(colon + 1);
+
+			std::optional<size_t> offset;
+			if (size_t at = field.find('@'); at != std::string_view::npos)
+			{
+				offset = parse_layout_number(field.substr(at + 1));
+				if (!offset)
+				{
+					return std::nullopt;
+				}
+				field = field.substr(0, at);
+			}
+			if (size_t open = field.find('['); open != std::string_view::npos)
+			{
+				if (!field.ends_with(']'))
+				{
+					return std::nullopt;
+				}
+				auto count = parse_layout_number(
+				  field.substr(open + 1, field.size() - open - 2));
+				if (!count || (*count == 0))
+				{
+					return std::nullopt;
+				}
+				result.count = *count;
+				field        = field.substr(0, open);
+			}
+
+			if (field == "char")
+			{
+				if (result.count == 0)
+				{
+					return std::nullopt;
+				}
+				result.isString = true;
+				result.width    = 1;
+			}
+			else if ((field.size() >= 2) &&
+			         ((field[0] == 'u') || (field[0] == 'i')))
+			{
+				auto bits = parse_layout_number(field.substr(1));
+				if (!bits || ((*bits != 8) && (*bits != 16) && (*bits != 32)))
+				{
+					return std::nullopt;
+				}
+				result.isSigned = (field[0] == 'i');
+				result.width    = *bits / 8;
+			}
+			else
+			{
+				return std::nullopt;
+			}
+			// Width is at most four, so this checks that neither the size
+			// nor the end of the field overflows.
+			if ((result.count > MaxSealedObjectSize / result.width) ||
+			    (offset.value_or(nextOffset) >
+			     MaxSealedObjectSize - result.size()))
+			{
+				return std::nullopt;
+			}
+			result.offset = offset.value_or(nextOffset);
+			nextOffset    = result.offset + result.size();
+			layout.push_back(std::move(result));
+		}
+		return layout;
+	}
+
+	/**
+	 * Read a little-endian integer of `width` bytes from `bytes`, sign
+	 * extending it if requested.  The caller is responsible for bounds
+	 * checking.
+	 */
+	int64_t read_layout_integer(std::span<const uint8_t> bytes,
+	                            size_t                   offset,
+	                            size_t                   width,
+	                            bool                     isSigned)
+	{
+		uint32_t value = 0;
+		for (size_t i = 0; i < width; i++)
+		{
+			value |= uint32_t(bytes[offset + i]) << (i * 8);
+		}
+		if (isSigned && (width < 4))
+		{
+			uint32_t signBit = uint32_t(1) << (width * 8 - 1);
+			if (value & signBit)
+			{
+				value |= ~((signBit << 1) - 1);
+			}
+		}
+		return isSigned ? int64_t(int32_t(value)) : int64_t(value);
+	}
+
+	/**
+	 * Process-wide cache of compiled layouts, keyed by descriptor.  Policies
+	 * typically use a small number of descriptors for every sealed object of
+	 * a given type, so each descriptor is compiled once.  Invalid descriptors
+	 * are cached as null.
+	 */
+	class SealedObjectLayoutCache
+	{
+		std::shared_mutex lock;
+		std::unordered_map<std::string,
+		                   std::shared_ptr<const SealedObjectLayout>,
+		                   StringViewHash,
+		                   std::equal_to<>>
+		  layouts;
+
+		public:
+		std::shared_ptr<const SealedObjectLayout>
+		get(std::string_view descriptor)
+		{
+			{
+				std::shared_lock guard{lock};
+				if (auto it = layouts.find(descriptor); it != layouts.end())
+				{
+					return it->second;
+				}
+			}
+			std::shared_ptr<const SealedObjectLayout> layout;
+			if (auto compiled = compile_sealed_object_layout(descriptor))
+			{
+				layout = std::make_shared<const SealedObjectLayout>(
+				  std::move(*compiled));
+			}
+			std::unique_lock guard{lock};
+			layouts.emplace(descriptor, layout);
+			return layout;
+		}
+	};
+
+	/**
+	 * The cache used by the `decode_sealed_object` built-in function.
+	 */
+	SealedObjectLayoutCache sealedObjectLayouts;
+} // namespace
@@ -0,0 +1,271 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <sys/resource.h>
+
+namespace
+{
+	/**
+	 * Number of allocations made with the global `operator new` by the
+	 * current thread.  This is per-thread so that the allocations attributed
+	 * to a built-in function or rule are exactly those that it made, even
+	 * when other threads are evaluating queries concurrently.  This and
+	 * `totalAllocationCount` are only updated if the
+	 * `CHERIOT_AUDIT_COUNT_ALLOCATIONS` build option is enabled, because the
+	 * replacement `operator new` that counts allocations conflicts with the
+	 * one that rego-cpp's snmalloc support provides.
+	 */
+	thread_local uint64_t allocationCount = 0;
+
+	/**
+	 * Number of allocations made with the global `operator new` by all
+	 * threads.  Phases such as hash verification and parallel evaluation
+	 * start worker threads, so allocations are attributed to phases using
+	 * this count.  A phase therefore also includes any allocations made by
+	 * other phases running at the same time.
+	 */
+	std::atomic<uint64_t> totalAllocationCount = 0;
+
+	/**
+	 * Returns true if allocations are being counted.
+	 */
+	constexpr bool counting_allocations()
+	{
+#ifdef CHERIOT_AUDIT_COUNT_ALLOCATIONS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * Returns the peak resident set size of the process so far, in bytes, or
+	 * zero if it is not available.
+	 */
+	uint64_t peak_memory_bytes()
+	{
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+		{
+			return 0;
+		}
+#ifdef __APPLE__
+		return usage.ru_maxrss;
+#else
+		// Linux and the BSDs report this in KiB.
+		return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+	}
+
+	/**
+	 * Statistics for one built-in function.
+	 */
+	struct BuiltinProfile
+	{
+		/// The number of times that the function was called.
+		std::atomic<uint64_t> calls = 0;
+		/// The total time spent in the function.
+		std::atomic<uint64_t> nanoseconds = 0;
+		/// The total number of allocations made by the function.
+		std::atomic<uint64_t> allocations = 0;
+	};
+
+	/**
+	 * Per-function statistics for built-in functions.  The template parameter
+	 * is the function that implements the built-in.
+	 */
+	template<auto Fn>
+	BuiltinProfile builtinProfile;
+
+	/**
+	 * Collects timing information for the phases of an audit, for built-in
+	 * functions, and for individual rules.  Everything is thread safe so that
+	 * phases running in worker threads can be recorded.  Times from
+	 * concurrent phases are summed.
+	 */
+	class Profiler
+	{
+		/**
+		 * Accumulated statistics for a phase or rule.
+		 */
+		struct Totals
+		{
+			uint64_t                 count = 0;
+			std::chrono::nanoseconds time{0};
+			uint64_t                 allocations = 0;
+		};
+
+		std::mutex                                    lock;
+		std::map<std::string, Totals>                 phases;
+		std::map<std::string, Totals>                 rules;
+		std::map<std::string, const BuiltinProfile *> builtins;
+
+		/**
+		 * Convert a set of totals to JSON.
+		 */
+		static nlohmann::json to_json(const Totals &totals)
+		{
+			nlohmann::json result{
+			  {"count", totals.count},
+			  {"seconds",
+			   std::chrono::duration<double>(totals.time).count()}};
+			if (counting_allocations())
+			{
+				result["allocations"] = totals.allocations;
+			}
+			return result;
+		}
+
+		public:
+		/// Is profiling enabled?
+		std::atomic<bool> enabled = false;
+
+		/**
+		 * RAII helper that records the time between its construction and
+		 * destruction.
+		 */
+		class Timer
+		{
+			Profiler                             *profiler;
+			std::map<std::string, Totals>        *totals;
+			std::string                           name;
+			std::chrono::steady_clock::time_point start;
+			/// Count allocations from all threads, not just this one?
+			bool                                  allThreads;
+			uint64_t                              startAllocations;
+
+			/**
+			 * The allocation counter that this timer uses.
+			 */
+			[[nodiscard]] uint64_t allocations() const
+			{
+				return allThreads ? totalAllocationCount.load() : allocationCount;
+			}
+
+			public:
+			Timer(Profiler                      *profiler,
+			      std::map<std::string, Totals> *totals,
+			      std::string                    name,
+			      bool                           allThreads)
+			  : profiler(profiler),
+			    totals(totals),
+			    name(std::move(name)),
+			    start(std::chrono::steady_clock::now()),
+			    allThreads(allThreads),
+			    startAllocations(allocations())
+			{
+			}
+
+			Timer(const Timer &) = delete;
+
+			~Timer()
+			{
+				if (!profiler->enabled)
+				{
+					return;
+				}
+				auto elapsed = std::chrono::steady_clock::now() - start;
+				std::unique_lock guard{profiler->lock};
+				auto            &entry = (*totals)[name];
+				entry.count++;
+				entry.time += elapsed;
+				entry.allocations += allocations() - startAllocations;
+			}
+		};
+
+		/**
+		 * Time a phase of the audit.  Allocations are counted across all
+		 * threads.
+		 */
+		Timer phase(std::string name)
+		{
+			return Timer(this, &phases, std::move(name), true);
+		}
+
+		/**
+		 * Time the evaluation of a rule.  Allocations are counted only on
+		 * the current thread.
+		 */
+		Timer rule(std::string name)
+		{
+			return Timer(this, &rules, std::move(name), false);
+		}
+
+		/**
+		 * Associate a name with the statistics for a built-in function.
+		 */
+		void name_builtin(const std::string    &name,
+		                  const BuiltinProfile &profile)
+		{
+			std::unique_lock guard{lock};
+			builtins[name] = &profile;
+		}
+
+		/**
+		 * Produce a JSON report of everything that has been recorded.
+		 */
+		nlohmann::json report()
+		{
+			std::unique_lock guard{lock};
+			nlohmann::json   result{{"phases", nlohmann::json::object()},
+			                        {"builtins", nlohmann::json::object()},
+			                        {"rules", nlohmann::json::object()},
+			                        {"peak_memory_bytes", peak_memory_bytes()}};
+			for (auto &[name, totals] : phases)
+			{
+				result["phases"][name] = to_json(totals);
+			}
+			for (auto &[name, totals] : rules)
+			{
+				result["rules"][name] = to_json(totals);
+			}
+			for (auto &[name, profile] : builtins)
+			{
+				result["builtins"][name] = to_json(
+				  {profile->calls,
+				   std::chrono::nanoseconds(profile->nanoseconds.load()),
+				   profile->allocations});
+			}
+			return result;
+		}
+	};
+
+	/**
+	 * The profiler used for this run.
+	 */
+	Profiler profiler;
+} // namespace
+
+#ifdef CHERIOT_AUDIT_COUNT_ALLOCATIONS
+// Replacement global allocation functions that count allocations.  These must
+// be at global scope and so are outside of the anonymous namespace.
+void *operator new(std::size_t size)
+{
+	allocationCount++;
+	totalAllocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void *ptr = std::malloc(size == 0 ? 1 : size))
+	{
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+#endif
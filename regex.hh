@@ -0,0 +1,67 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <memory>
+#include <mutex>
+#include <re2/re2.h>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "string_hash.hh"
+
+namespace
+{
+	/**
+	 * Process-wide cache of compiled regular expressions, keyed by pattern.
+	 * Allow-list policies typically match the same small set of patterns
+	 * against every export in the image, so each pattern is compiled once.
+	 * Patterns that fail to compile are cached as null.
+	 *
+	 * Patterns are compiled with RE2, which rego-cpp uses to implement
+	 * `regex.match`, so they have exactly the same syntax and semantics as
+	 * in Rego and are matched in linear time.  RE2 is available to us
+	 * through rego-cpp's dependency on it.
+	 *
+	 * Compiled expressions are immutable and so can be used concurrently by
+	 * interpreters on different threads.
+	 */
+	class RegexCache
+	{
+		std::shared_mutex lock;
+		std::unordered_map<std::string,
+		                   std::shared_ptr<const RE2>,
+		                   StringViewHash,
+		                   std::equal_to<>>
+		  expressions;
+
+		public:
+		std::shared_ptr<const RE2> get(std::string_view pattern)
+		{
+			{
+				std::shared_lock guard{lock};
+				if (auto it = expressions.find(pattern);
+				    it != expressions.end())
+				{
+					return it->second;
+				}
+			}
+			RE2::Options options;
+			options.set_log_errors(false);
+			auto expression = std::make_shared<const RE2>(pattern, options);
+			if (!expression->ok())
+			{
+				expression = nullptr;
+			}
+			std::unique_lock guard{lock};
+			expressions.emplace(pattern, expression);
+			return expression;
+		}
+	};
+
+	/**
+	 * The cache used by the `export_table_match` built-in function.
+	 */
+	RegexCache compiledPatterns;
+} // namespace
@@ -0,0 +1,208 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "hex.hh"
+#include "json_field.hh"
+
+namespace
+{
+	/**
+	 * Returns true if an import table entry is an allocator capability: a
+	 * static sealed object sealed with the allocator's `MallocKey`.
+	 */
+	bool is_allocator_capability(const nlohmann::json &entry)
+	{
+		if ((string_field(entry, "kind") != "SealedObject") ||
+		    !entry.contains("sealing_type"))
+		{
+			return false;
+		}
+		auto &sealingType = entry["sealing_type"];
+		auto  compartment = string_field(sealingType, "compartment");
+		return ((compartment == "allocator") || (compartment == "alloc")) &&
+		       (string_field(sealingType, "key") == "MallocKey");
+	}
+
+	/**
+	 * Decode the quota from an allocator capability.  The capability is a
+	 * 32-bit quota followed by five reserved words that must be zero.  The
+	 * contents are looked up in `sealedObjects`, the decoded sealed objects
+	 * of the image.  Returns an empty optional if the capability is not
+	 * valid.
+	 */
+	std::optional<uint32_t>
+	allocator_capability_quota(const nlohmann::json       &entry,
+	                           const SealedObjectContents &sealedObjects)
+	{
+		if (!entry.contains("contents") || !entry["contents"].is_string())
+		{
+			return std::nullopt;
+		}
+		std::vector<uint8_t> scratch;
+		auto                 bytes = sealedObjects.get(
+		  entry["contents"].get_ref<const std::string &>(), scratch);
+		if (bytes.size() < 24)
+		{
+			return std::nullopt;
+		}
+		for (size_t i = 4; i < 24; i++)
+		{
+			if (bytes[i] != 0)
+			{
+				return std::nullopt;
+			}
+		}
+		return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) |
+		       (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+	}
+
+	/**
+	 * Returns the `length` of a region, or the difference between its `end`
+	 * and `start`, or zero if neither is present as an unsigned number or
+	 * `end` is before `start`.
+	 */
+	uint64_t region_size(const nlohmann::json &region)
+	{
+		auto field = [&](const char *name) -> std::optional<uint64_t> {
+			if (!region.contains(name) || !region[name].is_number_unsigned())
+			{
+				return std::nullopt;
+			}
+			return region[name].get<uint64_t>();
+		};
+		if (auto length = field("length"))
+		{
+			return *length;
+		}
+		auto start = field("start");
+		auto end   = field("end");
+		if (start && end && (*end >= *start))
+		{
+			return *end - *start;
+		}
+		return 0;
+	}
+
+	/**
+	 * Build the resource accounting document that is exposed to Rego as
+	 * `data.resources`, using `sealedObjects` to decode allocator
+	 * capabilities.  It contains:
+	 *
+	 *  - `compartments`, mapping each compartment or library to the number
+	 *    of `allocator_capabilities` that it holds, the total `quota` of the
+	 *    valid ones, and the number of `invalid_allocator_capabilities`.
+	 *  - `threads`, an array with the `compartment` containing the entry
+	 *    point, `priority`, `stack` size, and `trusted_stack` size of each
+	 *    thread, in the same order as the report.
+	 *  - `shared_objects`, mapping each shared object to its size.
+	 *  - `totals`, with the total `quota`, `stack`, `trusted_stack`, and
+	 *    `shared_objects` sizes for the whole image.
+	 *  - `heap`, the size of the heap from the board description, if the
+	 *    board gives both its start and end.
+	 */
+	nlohmann::json build_resources(const nlohmann::json       &report,
+	                               const nlohmann::json       &board,
+	                               const SealedObjectContents &sealedObjects)
+	{
+		nlohmann::json compartments  = nlohmann::json::object();
+		nlohmann::json threads       = nlohmann::json::array();
+		nlohmann::json sharedObjects = nlohmann::json::object();
+		uint64_t       totalQuota    = 0;
+		uint64_t       totalStack    = 0;
+		uint64_t       totalTrusted  = 0;
+		uint64_t       totalShared   = 0;
+		if (report.contains("compartments"))
+		{
+			for (auto &[name, compartment] : report["compartments"].items())
+			{
+				uint64_t capabilities = 0;
+				uint64_t invalid      = 0;
+				uint64_t quota        = 0;
+				if (compartment.contains("imports"))
+				{
+					for (auto &entry : compartment["imports"])
+					{
+						if (!is_allocator_capability(entry))
+						{
+							continue;
+						}
+						capabilities++;
+						if (auto decoded =
+						      allocator_capability_quota(entry, sealedObjects))
+						{
+							quota += *decoded;
+						}
+						else
+						{
+							invalid++;
+						}
+					}
+				}
+				totalQuota += quota;
+				compartments[name] = {
+				  {"allocator_capabilities", capabilities},
+				  {"invalid_allocator_capabilities", invalid},
+				  {"quota", quota}};
+			}
+		}
+		if (report.contains("threads"))
+		{
+			for (auto &thread : report["threads"])
+			{
+				uint64_t stack   = thread.contains("stack")
+				                     ? region_size(thread["stack"])
+				                     : 0;
+				uint64_t trusted = thread.contains("trusted_stack")
+				                     ? region_size(thread["trusted_stack"])
+				                     : 0;
+				std::string compartment;
+				if (thread.contains("entry_point"))
+				{
+					compartment =
+					  string_field(thread["entry_point"], "compartment_name");
+				}
+				totalStack += stack;
+				totalTrusted += trusted;
+				int64_t priority = (thread.contains("priority") &&
+				                    thread["priority"].is_number_integer())
+				                     ? thread["priority"].get<int64_t>()
+				                     : 0;
+				threads.push_back({{"compartment", compartment},
+				                   {"priority", priority},
+				                   {"stack", stack},
+				                   {"trusted_stack", trusted}});
+			}
+		}
+		if (report.contains("sharedObjects"))
+		{
+			for (auto &object : report["sharedObjects"])
+			{
+				uint64_t size = region_size(object);
+				totalShared += size;
+				sharedObjects[std::string(string_field(object, "name"))] = size;
+			}
+		}
+		nlohmann::json resources{{"compartments", compartments},
+		                         {"threads", threads},
+		                         {"shared_objects", sharedObjects},
+		                         {"totals",
+		                          {{"quota", totalQuota},
+		                           {"stack", totalStack},
+		                           {"trusted_stack", totalTrusted},
+		                           {"shared_objects", totalShared}}}};
+		if (board.contains("heap") && board["heap"].contains("start") &&
+		    board["heap"].contains("end"))
+		{
+			resources["heap"] = region_size(board["heap"]);
+		}
+		return resources;
+	}
+} // namespace
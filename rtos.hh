@@ -20,15 +20,13 @@ namespace
 
 		decode_allocator_capability(capability) = decoded if {
 			is_allocator_capability(capability)
-			some quota
-			quota = integer_from_hex_string(capability.contents, 0, 4)
+			some fields
+			fields = decode_sealed_object(capability.contents, "quota:u32 reserved:u32[5]")
 			# Remaining words are all zero
-			integer_from_hex_string(capability.contents, 4, 4) == 0
-			integer_from_hex_string(capability.contents, 8, 4) == 0
-			integer_from_hex_string(capability.contents, 12, 4) == 0
-			integer_from_hex_string(capability.contents, 16, 4) == 0
-			integer_from_hex_string(capability.contents, 20, 4) == 0
-			decoded := { "quota": quota }
+			every word in fields.reserved {
+				word == 0
+			}
+			decoded := { "quota": fields.quota }
 		}
 
 		all_sealed_allocator_capabilities_are_valid if {
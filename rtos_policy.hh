@@ -0,0 +1,212 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <array>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "json_field.hh"
+#include "resources.hh"
+
+namespace
+{
+	/**
+	 * The result of checking a firmware image against the RTOS policy.
+	 */
+	struct RTOSPolicyVerdict
+	{
+		/// Does the image satisfy every clause of the policy?
+		bool valid = true;
+		/// The names of the clauses that do not hold, in policy order.
+		std::vector<std::string> violations;
+	};
+
+	/**
+	 * Native implementation of `data.rtos.valid`, using `sealedObjects` to
+	 * decode allocator capabilities.  This makes a single pass over the
+	 * imports of every compartment and library, and one over the shared
+	 * objects, instead of the separate scans made by each clause of the Rego
+	 * definition.
+	 *
+	 * The Rego rule is undefined if any clause is undefined, for example if
+	 * the board does not describe one of the devices.  Here, `valid` is
+	 * false in that case and the clause is reported as violated.  The
+	 * clauses are reported as:
+	 *
+	 *  - `all_sealed_allocator_capabilities_are_valid`
+	 *  - `mmio_allow_list(revoker)`
+	 *  - `mmio_allow_list(clint)`
+	 *  - `mmio_allow_list(plic)`
+	 *  - `shared_object_allow_list(allocator_hazard_pointers)`
+	 *  - `shared_object_writeable_allow_list(allocator_epoch)`
+	 *  - `hazard_list_size`
+	 *  - `epoch_size`
+	 *
+	 * This must be kept in sync with `rtosPackage`.  The `rtos_policy`
+	 * tests check that the two agree.
+	 */
+	RTOSPolicyVerdict
+	check_rtos_policy(const nlohmann::json       &report,
+	                  const nlohmann::json       &board,
+	                  const SealedObjectContents &sealedObjects)
+	{
+		/**
+		 * A device that only the listed compartment may import.
+		 */
+		struct DeviceRule
+		{
+			/// The name of the device on the board.
+			const char *device;
+			/// The only compartment that may import the device.
+			const char *allowed;
+			/// The start and length of the device, if the board gives them.
+			std::optional<std::pair<uint64_t, uint64_t>> range;
+			/**
+			 * Does the rule hold for the imports seen so far?  Rules for
+			 * devices that the board does not describe never hold.
+			 */
+			bool holds = false;
+		};
+		std::array<DeviceRule, 3> deviceRules{
+		  {{"revoker", "allocator", std::nullopt, false},
+		   {"clint", "scheduler", std::nullopt, false},
+		   {"plic", "scheduler", std::nullopt, false}}};
+		if (board.contains("devices") && board["devices"].is_object())
+		{
+			auto &devices = board["devices"];
+			for (auto &rule : deviceRules)
+			{
+				auto device = devices.find(rule.device);
+				if ((device != devices.end()) &&
+				    device->contains("start") && device->contains("length") &&
+				    (*device)["start"].is_number_unsigned() &&
+				    (*device)["length"].is_number_unsigned())
+				{
+					rule.range = {(*device)["start"].get<uint64_t>(),
+					              (*device)["length"].get<uint64_t>()};
+					rule.holds = true;
+				}
+			}
+		}
+		bool capabilitiesValid = true;
+		bool hazardListAllowed = true;
+		bool epochAllowed      = true;
+		if (report.contains("compartments"))
+		{
+			for (auto &[name, compartment] : report["compartments"].items())
+			{
+				if (!compartment.contains("imports"))
+				{
+					continue;
+				}
+				for (auto &entry : compartment["imports"])
+				{
+					auto kind = string_field(entry, "kind");
+					if (kind == "MMIO")
+					{
+						// Imports without a numeric range are not in the
+						// device index, so `mmio_importers` never finds them.
+						if (!entry.contains("start") ||
+						    !entry.contains("length") ||
+						    !entry["start"].is_number_unsigned() ||
+						    !entry["length"].is_number_unsigned())
+						{
+							continue;
+						}
+						std::pair<uint64_t, uint64_t> range{
+						  entry["start"].get<uint64_t>(),
+						  entry["length"].get<uint64_t>()};
+						for (auto &rule : deviceRules)
+						{
+							if ((rule.range == range) && (name != rule.allowed))
+							{
+								rule.holds = false;
+							}
+						}
+					}
+					else if (kind == "SharedObject")
+					{
+						auto object = string_field(entry, "shared_object");
+						if ((object == "allocator_hazard_pointers") &&
+						    (name != "allocator"))
+						{
+							hazardListAllowed = false;
+						}
+						if ((object == "allocator_epoch") &&
+						    entry.contains("permits_store") &&
+						    (entry["permits_store"] == true) &&
+						    (name != "allocator"))
+						{
+							epochAllowed = false;
+						}
+					}
+					else if (is_allocator_capability(entry) &&
+					         !allocator_capability_quota(entry, sealedObjects))
+					{
+						capabilitiesValid = false;
+					}
+				}
+			}
+		}
+		// The sizes of the shared objects, if there is exactly one with the
+		// name.
+		std::optional<int64_t> hazardListSize;
+		std::optional<int64_t> epochSize;
+		size_t                 hazardLists = 0;
+		size_t                 epochs      = 0;
+		if (report.contains("sharedObjects"))
+		{
+			for (auto &object : report["sharedObjects"])
+			{
+				auto name         = string_field(object, "name");
+				bool isHazardList = name == "allocator_hazard_pointers";
+				if (!isHazardList && (name != "allocator_epoch"))
+				{
+					continue;
+				}
+				std::optional<int64_t> size;
+				if (object.contains("start") && object.contains("end") &&
+				    object["start"].is_number_integer() &&
+				    object["end"].is_number_integer())
+				{
+					size = object["end"].get<int64_t>() -
+					       object["start"].get<int64_t>();
+				}
+				(isHazardList ? hazardLists : epochs)++;
+				(isHazardList ? hazardListSize : epochSize) = size;
+			}
+		}
+		// Two hazard pointers per thread.
+		bool hazardListSizeValid =
+		  (hazardLists == 1) && hazardListSize && report.contains("threads") &&
+		  report["threads"].is_array() &&
+		  (*hazardListSize == int64_t(report["threads"].size() * 2 * 8));
+		// 32-bit epoch.
+		bool epochSizeValid = (epochs == 1) && epochSize && (*epochSize == 4);
+
+		RTOSPolicyVerdict verdict;
+		auto              check = [&](bool holds, std::string clause) {
+			if (!holds)
+			{
+				verdict.valid = false;
+				verdict.violations.push_back(std::move(clause));
+			}
+		};
+		check(capabilitiesValid, "all_sealed_allocator_capabilities_are_valid");
+		for (auto &rule : deviceRules)
+		{
+			check(rule.holds,
+			      std::string("mmio_allow_list(") + rule.device + ")");
+		}
+		check(hazardListAllowed,
+		      "shared_object_allow_list(allocator_hazard_pointers)");
+		check(epochAllowed,
+		      "shared_object_writeable_allow_list(allocator_epoch)");
+		check(hazardListSizeValid, "hazard_list_size");
+		check(epochSizeValid, "epoch_size");
+		return verdict;
+	}
+} // namespace
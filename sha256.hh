@@ -0,0 +1,183 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+
+namespace
+{
+	/**
+	 * Incremental SHA-256, as used by the linker for the hashes in firmware
+	 * reports.  Data is passed to `update` in as many pieces as required and
+	 * `hex_digest` returns the hash of everything passed so far.
+	 */
+	class SHA256
+	{
+		/// The round constants.
+		static constexpr std::array<uint32_t, 64> K = {
+		  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+		  0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+		  0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+		  0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+		  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+		  0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+		  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+		  0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+		  0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+		  0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+		  0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+		  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+		/// The hash state.
+		std::array<uint32_t, 8> state = {0x6a09e667,
+		                                 0xbb67ae85,
+		                                 0x3c6ef372,
+		                                 0xa54ff53a,
+		                                 0x510e527f,
+		                                 0x9b05688c,
+		                                 0x1f83d9ab,
+		                                 0x5be0cd19};
+		/// Bytes that do not yet fill a block.
+		std::array<uint8_t, 64> buffer;
+		/// The number of bytes in `buffer`.
+		size_t buffered = 0;
+		/// The total number of bytes hashed.
+		uint64_t length = 0;
+
+		static constexpr uint32_t rotr(uint32_t x, int n)
+		{
+			return (x >> n) | (x << (32 - n));
+		}
+
+		/**
+		 * Process whole 64-byte blocks, directly from the caller's buffer
+		 * where possible so that large sections are not copied.
+		 */
+		void compress(const uint8_t *blocks, size_t count)
+		{
+			for (; count > 0; count--, blocks += 64)
+			{
+				std::array<uint32_t, 64> w;
+				for (size_t i = 0; i < 16; i++)
+				{
+					w[i] = (uint32_t(blocks[i * 4]) << 24) |
+					       (uint32_t(blocks[i * 4 + 1]) << 16) |
+					       (uint32_t(blocks[i * 4 + 2]) << 8) |
+					       uint32_t(blocks[i * 4 + 3]);
+				}
+				for (size_t i = 16; i < 64; i++)
+				{
+					uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^
+					              (w[i - 15] >> 3);
+					uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^
+					              (w[i - 2] >> 10);
+					w[i]        = w[i - 16] + s0 + w[i - 7] + s1;
+				}
+				auto [a, b, c, d, e, f, g, h] = state;
+				for (size_t i = 0; i < 64; i++)
+				{
+					uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+					uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + K[i] + w[i];
+					uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+					uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+					h           = g;
+					g           = f;
+					f           = e;
+					e           = d + t1;
+					d           = c;
+					c           = b;
+					b           = a;
+					a           = t1 + t2;
+				}
+				state[0] += a;
+				state[1] += b;
+				state[2] += c;
+				state[3] += d;
+				state[4] += e;
+				state[5] += f;
+				state[6] += g;
+				state[7] += h;
+			}
+		}
+
+		public:
+		/**
+		 * Add `data` to the hash.
+		 */
+		void update(std::span<const uint8_t> data)
+		{
+			if (data.empty())
+			{
+				return;
+			}
+			length += data.size();
+			if (buffered > 0)
+			{
+				size_t copy = std::min(data.size(), buffer.size() - buffered);
+				memcpy(buffer.data() + buffered, data.data(), copy);
+				buffered += copy;
+				data = data.subspan(copy);
+				if (buffered < buffer.size())
+				{
+					return;
+				}
+				compress(buffer.data(), 1);
+				buffered = 0;
+			}
+			compress(data.data(), data.size() / 64);
+			buffered = data.size() % 64;
+			memcpy(buffer.data(), data.data() + data.size() - buffered, buffered);
+		}
+
+		/**
+		 * Returns the hash of the data passed to `update` as a lower-case
+		 * hex string.  This finalises the hash, so no more data may be added
+		 * afterwards.
+		 */
+		std::string hex_digest()
+		{
+			uint64_t bits      = length * 8;
+			buffer[buffered++] = 0x80;
+			if (buffered > 56)
+			{
+				std::fill(buffer.begin() + buffered, buffer.end(), 0);
+				compress(buffer.data(), 1);
+				buffered = 0;
+			}
+			std::fill(buffer.begin() + buffered, buffer.begin() + 56, 0);
+			for (size_t i = 0; i < 8; i++)
+			{
+				buffer[63 - i] = (bits >> (i * 8)) & 0xff;
+			}
+			compress(buffer.data(), 1);
+			static constexpr char Digits[] = "0123456789abcdef";
+			std::string           result;
+			result.reserve(64);
+			for (uint32_t word : state)
+			{
+				for (int shift = 28; shift >= 0; shift -= 4)
+				{
+					result.push_back(Digits[(word >> shift) & 0xf]);
+				}
+			}
+			return result;
+		}
+	};
+
+	/**
+	 * Returns the SHA-256 hash of `data` as a lower-case hex string.
+	 */
+	std::string sha256(std::span<const uint8_t> data)
+	{
+		SHA256 hash;
+		hash.update(data);
+		return hash.hex_digest();
+	}
+} // namespace
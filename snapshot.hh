@@ -0,0 +1,218 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+	/**
+	 * The magic number at the start of a snapshot file.  Snapshots begin with
+	 * these eight bytes, followed by a 32-bit format version, the 32-bit
+	 * number of sections in the firmware report, and then a sequence of
+	 * records.  The first record is the normalised board description and
+	 * each of the others is one top-level section of the firmware report.  Each record is the 32-bit length of its name,
+	 * the name (empty for the board), the 64-bit length of its contents,
+	 * and the contents encoded as CBOR.  All integers are little endian.
+	 * Sections are encoded separately so that a reader can decode only the
+	 * sections that it needs and skip the rest without touching them.
+	 */
+	constexpr char SnapshotMagic[8] = {'C', 'H', 'E', 'R', 'I', 'O', 'T', 'S'};
+
+	/**
+	 * The version of the snapshot format.  Snapshots with a different version
+	 * are rejected.
+	 */
+	constexpr uint32_t SnapshotFormatVersion = 2;
+
+	/**
+	 * The size of the snapshot header.
+	 */
+	constexpr size_t SnapshotHeaderSize = sizeof(SnapshotMagic) + 4;
+
+	/**
+	 * The contents of a snapshot.
+	 */
+	struct Snapshot
+	{
+		/// The firmware report.
+		nlohmann::json report;
+		/// The board description, normalised as by `parse_board_json`.
+		nlohmann::json board;
+	};
+
+	/**
+	 * Returns true if the file at `path` starts with the snapshot magic
+	 * number.
+	 */
+	bool is_snapshot(const std::filesystem::path &path)
+	{
+		std::ifstream stream(path, std::ios::binary);
+		char          magic[sizeof(SnapshotMagic)];
+		return stream.read(magic, sizeof(magic)) &&
+		       (memcmp(magic, SnapshotMagic, sizeof(magic)) == 0);
+	}
+
+	/**
+	 * Write a snapshot of a firmware report and board description.  Returns
+	 * false if the file cannot be written.
+	 */
+	bool write_snapshot(const std::filesystem::path &path,
+	                    const nlohmann::json        &report,
+	                    const nlohmann::json        &board)
+	{
+		std::vector<uint8_t> contents(SnapshotMagic,
+		                              SnapshotMagic + sizeof(SnapshotMagic));
+		auto                 addInteger = [&](uint64_t value, size_t bytes) {
+			for (size_t i = 0; i < bytes; i++)
+			{
+				contents.push_back((value >> (i * 8)) & 0xff);
+			}
+		};
+		auto addRecord = [&](std::string_view name, const nlohmann::json &value) {
+			addInteger(name.size(), 4);
+			contents.insert(contents.end(), name.begin(), name.end());
+			auto encoded = nlohmann::json::to_cbor(value);
+			addInteger(encoded.size(), 8);
+			contents.insert(contents.end(), encoded.begin(), encoded.end());
+		};
+		addInteger(SnapshotFormatVersion, 4);
+		addInteger(report.size(), 4);
+		addRecord("", board);
+		for (auto &[name, section] : report.items())
+		{
+			addRecord(name, section);
+		}
+		std::ofstream stream(path, std::ios::binary);
+		stream.write(reinterpret_cast<const char *>(contents.data()),
+		             contents.size());
+		return stream.good();
+	}
+
+	/**
+	 * Read a snapshot.  The file is mapped into memory and each section is
+	 * decoded in place, so loading a snapshot avoids both copying the file
+	 * and parsing JSON text.  If `sections` is not empty then only those
+	 * top-level sections of the report are decoded, and the others are
+	 * skipped without being read.  The board description is decoded only if
+	 * `needBoard` is true.  Returns an empty optional if the file is not a
+	 * valid snapshot.
+	 */
+	std::optional<Snapshot> read_snapshot(const std::filesystem::path &path,
+	                                      const std::set<std::string> &sections,
+	                                      bool needBoard)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return std::nullopt;
+		}
+		struct stat info;
+		if ((fstat(fd, &info) != 0) ||
+		    (size_t(info.st_size) < SnapshotHeaderSize))
+		{
+			close(fd);
+			return std::nullopt;
+		}
+		size_t size    = info.st_size;
+		void  *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED)
+		{
+			return std::nullopt;
+		}
+		std::span<const uint8_t> bytes{static_cast<const uint8_t *>(mapping),
+		                               size};
+		// Read a little-endian integer and advance past it, or return an
+		// empty optional if the file is too short.
+		auto readInteger = [&](size_t count) -> std::optional<uint64_t> {
+			if (bytes.size() < count)
+			{
+				return std::nullopt;
+			}
+			uint64_t value = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				value |= uint64_t(bytes[i]) << (i * 8);
+			}
+			bytes = bytes.subspan(count);
+			return value;
+		};
+		// Read the next record, returning its name and contents, or an empty
+		// optional if it is truncated.
+		auto readRecord = [&]()
+		  -> std::optional<std::pair<std::string, std::span<const uint8_t>>> {
+			auto nameLength = readInteger(4);
+			if (!nameLength || (bytes.size() < *nameLength))
+			{
+				return std::nullopt;
+			}
+			std::string name(reinterpret_cast<const char *>(bytes.data()),
+			                 *nameLength);
+			bytes       = bytes.subspan(*nameLength);
+			auto length = readInteger(8);
+			if (!length || (bytes.size() < *length))
+			{
+				return std::nullopt;
+			}
+			auto contents = bytes.first(*length);
+			bytes         = bytes.subspan(*length);
+			return std::pair{std::move(name), contents};
+		};
+		auto decode = [](std::span<const uint8_t> contents) {
+			return nlohmann::json::from_cbor(contents.begin(),
+			                                 contents.end(),
+			                                 /*strict*/ true,
+			                                 /*allow_exceptions*/ false);
+		};
+		bool valid =
+		  memcmp(bytes.data(), SnapshotMagic, sizeof(SnapshotMagic)) == 0;
+		bytes      = bytes.subspan(sizeof(SnapshotMagic));
+		valid      = valid && (readInteger(4) == SnapshotFormatVersion);
+		auto count = valid ? readInteger(4) : std::nullopt;
+		auto board = count ? readRecord() : std::nullopt;
+		valid      = valid && board && board->first.empty();
+		Snapshot snapshot{nlohmann::json::object(), nullptr};
+		if (valid && needBoard)
+		{
+			snapshot.board = decode(board->second);
+			valid          = snapshot.board.is_object();
+		}
+		for (uint64_t i = 0; valid && (i < *count); i++)
+		{
+			auto record = readRecord();
+			if (!record)
+			{
+				valid = false;
+				break;
+			}
+			if (sections.empty() || sections.contains(record->first))
+			{
+				auto section = decode(record->second);
+				valid        = !section.is_discarded();
+				snapshot.report[record->first] = std::move(section);
+			}
+		}
+		std::optional<Snapshot> result;
+		if (valid && bytes.empty())
+		{
+			result = std::move(snapshot);
+		}
+		munmap(mapping, size);
+		return result;
+	}
+} // namespace
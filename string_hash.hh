@@ -0,0 +1,25 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <functional>
+#include <string_view>
+
+namespace
+{
+	/**
+	 * Hash for unordered containers keyed by strings that allows lookups with
+	 * a `std::string_view`, so that finding an entry does not require
+	 * allocating a `std::string` for the key.  Use with `std::equal_to<>`.
+	 */
+	struct StringViewHash
+	{
+		using is_transparent = void;
+
+		size_t operator()(std::string_view string) const
+		{
+			return std::hash<std::string_view>{}(string);
+		}
+	};
+} // namespace
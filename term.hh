@@ -0,0 +1,93 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <rego/rego.hh>
+#include <string>
+
+namespace
+{
+	/**
+	 * Convert a parsed JSON value to a Rego term, using the same constructors
+	 * that the built-in functions use for their results.  This lets a
+	 * document that has already been parsed, for example to build the
+	 * native indexes, be given to an interpreter without writing it out as
+	 * JSON text for the interpreter to parse again.
+	 */
+	rego::Node json_to_term(const nlohmann::json &value)
+	{
+		using namespace rego;
+		switch (value.type())
+		{
+			case nlohmann::json::value_t::object:
+			{
+				Nodes items;
+				for (auto &[key, element] : value.items())
+				{
+					items.push_back(
+					  object_item(scalar(key), json_to_term(element)));
+				}
+				return object(items);
+			}
+			case nlohmann::json::value_t::array:
+			{
+				Nodes elements;
+				for (auto &element : value)
+				{
+					elements.push_back(json_to_term(element));
+				}
+				return array(elements);
+			}
+			case nlohmann::json::value_t::string:
+				return scalar(value.get_ref<const std::string &>());
+			case nlohmann::json::value_t::boolean:
+				return scalar(value.get<bool>());
+			case nlohmann::json::value_t::number_integer:
+				return scalar(BigInt{value.get<int64_t>()});
+			case nlohmann::json::value_t::number_unsigned:
+			{
+				auto number = value.get<uint64_t>();
+				if (number <= uint64_t(std::numeric_limits<int64_t>::max()))
+				{
+					return scalar(BigInt{int64_t(number)});
+				}
+				return scalar(BigInt{Location(std::to_string(number))});
+			}
+			case nlohmann::json::value_t::number_float:
+				return scalar(value.get<double>());
+			default:
+				return scalar();
+		}
+	}
+
+	/**
+	 * A Rego term that is built once and given to several interpreters, for
+	 * example the input and data documents of a firmware image that is
+	 * audited by more than one thread.  Interpreters take ownership of the
+	 * nodes that they are given and nodes are not thread safe, so each
+	 * interpreter is given its own copy.  Copying the tree is much cheaper
+	 * than converting or parsing the document again.
+	 */
+	class SharedTerm
+	{
+		/// Lock serialising copies of `term`.
+		mutable std::mutex lock;
+		/// The term, which is never given to an interpreter directly.
+		rego::Node term;
+
+		public:
+		explicit SharedTerm(rego::Node term) : term(std::move(term)) {}
+
+		/**
+		 * Returns a copy of the term for an interpreter to own.
+		 */
+		[[nodiscard]] rego::Node copy() const
+		{
+			std::lock_guard guard{lock};
+			return term->clone();
+		}
+	};
+} // namespace
@@ -0,0 +1,469 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "json_field.hh"
+#include "sha256.hh"
+
+namespace
+{
+	/**
+	 * A read-only memory mapping of a file.  The mapping is removed when
+	 * this is destroyed.
+	 */
+	class MappedFile
+	{
+		/// The mapping, or null if the file could not be mapped.
+		void *mapping = nullptr;
+		/// The size of the file.
+		size_t size = 0;
+		/// Could the file be opened?
+		bool opened = false;
+
+		public:
+		/**
+		 * Map the file at `path`.  Use `valid` to check whether this
+		 * succeeded.
+		 */
+		explicit MappedFile(const std::filesystem::path &path)
+		{
+			int fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+			{
+				return;
+			}
+			struct stat info;
+			if (fstat(fd, &info) == 0)
+			{
+				size   = info.st_size;
+				opened = true;
+				// Empty files cannot be mapped, but can still be hashed.
+				if (size > 0)
+				{
+					mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+					if (mapping == MAP_FAILED)
+					{
+						mapping = nullptr;
+						opened  = false;
+					}
+				}
+			}
+			close(fd);
+		}
+
+		MappedFile(const MappedFile &) = delete;
+
+		~MappedFile()
+		{
+			if (mapping != nullptr)
+			{
+				munmap(mapping, size);
+			}
+		}
+
+		/// Returns true if the file was read successfully.
+		[[nodiscard]] bool valid() const
+		{
+			return opened;
+		}
+
+		/// Returns the contents of the file.
+		[[nodiscard]] std::span<const uint8_t> bytes() const
+		{
+			return {static_cast<const uint8_t *>(mapping), size};
+		}
+	};
+
+	/**
+	 * A section in an ELF file.
+	 */
+	struct ELFSection
+	{
+		/// The name of the section.
+		std::string_view name;
+		/**
+		 * The contents of the section, or an empty optional if the section
+		 * occupies no space in the file (for example, `.bss`).
+		 */
+		std::optional<std::span<const uint8_t>> contents;
+		/// The size of the section in memory.
+		uint64_t size;
+	};
+
+	/**
+	 * Returns the sections of a little-endian ELF file, either 32- or 64-bit.
+	 * Returns an empty optional if the file is not a valid ELF file.
+	 */
+	std::optional<std::vector<ELFSection>>
+	elf_sections(std::span<const uint8_t> file)
+	{
+		auto read = [&](uint64_t offset, size_t bytes) -> uint64_t {
+			uint64_t value = 0;
+			for (size_t i = 0; i < bytes; i++)
+			{
+				value |= uint64_t(file[offset + i]) << (i * 8);
+			}
+			return value;
+		};
+		if ((file.size() < 0x40) || (file[0] != 0x7f) || (file[1] != 'E') ||
+		    (file[2] != 'L') || (file[3] != 'F') || (file[5] != 1))
+		{
+			return std::nullopt;
+		}
+		bool is64 = file[4] == 2;
+		// Offsets of the fields that we need in the ELF header and in each
+		// section header.
+		size_t   word          = is64 ? 8 : 4;
+		uint64_t sectionOffset = read(is64 ? 0x28 : 0x20, word);
+		uint64_t headerSize    = read(is64 ? 0x3a : 0x2e, 2);
+		uint64_t count         = read(is64 ? 0x3c : 0x30, 2);
+		uint64_t namesIndex    = read(is64 ? 0x3e : 0x32, 2);
+		size_t   offsetField   = is64 ? 0x18 : 0x10;
+		if ((headerSize < offsetField + 2 * word) || (namesIndex >= count) ||
+		    (sectionOffset > file.size()) ||
+		    (count * headerSize > file.size() - sectionOffset))
+		{
+			return std::nullopt;
+		}
+		constexpr uint32_t     NoBits = 8;
+		std::vector<ELFSection> sections;
+		std::vector<uint32_t>   nameOffsets;
+		for (uint64_t i = 0; i < count; i++)
+		{
+			uint64_t header = sectionOffset + i * headerSize;
+			uint64_t offset = read(header + offsetField, word);
+			uint64_t size   = read(header + offsetField + word, word);
+			nameOffsets.push_back(read(header, 4));
+			ELFSection section{{}, std::nullopt, size};
+			if (read(header + 4, 4) != NoBits)
+			{
+				if ((offset > file.size()) || (size > file.size() - offset))
+				{
+					return std::nullopt;
+				}
+				section.contents = file.subspan(offset, size);
+			}
+			sections.push_back(section);
+		}
+		if (!sections[namesIndex].contents)
+		{
+			return std::nullopt;
+		}
+		auto names = *sections[namesIndex].contents;
+		for (size_t i = 0; i < sections.size(); i++)
+		{
+			if (nameOffsets[i] >= names.size())
+			{
+				return std::nullopt;
+			}
+			auto start = reinterpret_cast<const char *>(names.data()) +
+			             nameOffsets[i];
+			sections[i].name = std::string_view(
+			  start, strnlen(start, names.size() - nameOffsets[i]));
+		}
+		return sections;
+	}
+
+	/**
+	 * Returns the SHA-256 hash of `size` zero bytes, which is the contents of
+	 * a section that occupies no space in the file.  The size comes from the
+	 * file being verified, so the zeroes are hashed in fixed-size chunks
+	 * rather than allocated.
+	 */
+	std::string sha256_zeroes(uint64_t size)
+	{
+		static constexpr std::array<uint8_t, 4096> Zeroes{};
+		SHA256                                      hash;
+		while (size > 0)
+		{
+			auto chunk = std::min<uint64_t>(size, Zeroes.size());
+			hash.update(std::span{Zeroes}.first(chunk));
+			size -= chunk;
+		}
+		return hash.hex_digest();
+	}
+
+	/**
+	 * The result of comparing a hash in a firmware report against the build
+	 * artefacts.
+	 */
+	enum class VerificationStatus
+	{
+		/// The hash matches.
+		Match,
+		/// The file and section exist but the contents have a different hash.
+		Mismatch,
+		/// The file or section could not be found.
+		Missing
+	};
+
+	/**
+	 * Returns the name of a verification status as exposed to Rego.
+	 */
+	const char *status_name(VerificationStatus status)
+	{
+		switch (status)
+		{
+			case VerificationStatus::Match:
+				return "match";
+			case VerificationStatus::Mismatch:
+				return "mismatch";
+			case VerificationStatus::Missing:
+				break;
+		}
+		return "missing";
+	}
+
+	/**
+	 * Re-hash the build artefacts that a firmware report was linked from,
+	 * and return the results for exposing to Rego as `data.verification`.
+	 * File names in the report are resolved relative to `buildDirectory`.
+	 *
+	 * For each input section of each compartment or library, the section
+	 * with the same name and size in the input file is hashed and compared
+	 * against the `sha256` in the report.  If the report does not give the
+	 * size of a section then it is found by name alone.  Sections that
+	 * occupy no space in the file are hashed as zeroes.  The output section
+	 * of each compartment or library, named by its `code` or `data` entry,
+	 * is found in the final image and compared against its `output.sha256`.
+	 * The final image is also hashed as a whole and compared against
+	 * `final_hash`.  A hash that is missing from the report, or is not a
+	 * string, never matches.  Each file is mapped and hashed only once, and
+	 * files are hashed in parallel on up to `threads` threads.
+	 *
+	 * The result contains:
+	 *
+	 *  - `compartments`, mapping each compartment or library to an object
+	 *    with `valid`, which is true if every input and output matches,
+	 *    `inputs`, an array of `{ "kind", "file", "section_name", "status" }`
+	 *    objects, and `outputs`, an array of `{ "kind", "section_name",
+	 *    "status" }` objects.  In both, `kind` is `code` or `data` and
+	 *    `status` is `match`, `mismatch`, or `missing`.
+	 *  - `final_hash`, the status of the final image.
+	 *  - `valid`, true if everything matches.
+	 */
+	nlohmann::json verify_report(const nlohmann::json        &report,
+	                             const std::filesystem::path &buildDirectory,
+	                             unsigned                     threads)
+	{
+		/**
+		 * A hash to check: a whole file if `wholeFile` is set, otherwise the
+		 * section with that name and, if given, size.  An empty `sha256`
+		 * never matches, because the report did not give a hash.
+		 */
+		struct Check
+		{
+			std::string             sectionName;
+			std::optional<uint64_t> size;
+			std::string             sha256;
+			bool                    wholeFile = false;
+			VerificationStatus      status    = VerificationStatus::Missing;
+		};
+		// The checks for each file.
+		std::map<std::string, std::vector<Check>> files;
+		// The input and output sections, in the order that they appear in
+		// the report, with the index of their check in the file's checks.
+		struct Section
+		{
+			std::string compartment;
+			std::string kind;
+			std::string file;
+			size_t      index;
+		};
+		std::vector<Section> inputs;
+		std::vector<Section> outputs;
+		auto addCheck = [&](const std::string &file, Check check) -> size_t {
+			auto &checks = files[file];
+			checks.push_back(std::move(check));
+			return checks.size() - 1;
+		};
+		std::optional<std::string> finalFile;
+		if (auto file = string_field(report, "file"); !file.empty())
+		{
+			finalFile = std::string(file);
+		}
+		if (report.contains("compartments"))
+		{
+			for (auto &[name, compartment] : report["compartments"].items())
+			{
+				for (auto kind : {"code", "data"})
+				{
+					auto it = compartment.find(kind);
+					if ((it == compartment.end()) || !it->is_object())
+					{
+						continue;
+					}
+					if (it->contains("inputs"))
+					{
+						for (auto &input : (*it)["inputs"])
+						{
+							// A section without a size is found by name
+							// alone.
+							std::optional<uint64_t> size;
+							if (input.contains("size") &&
+							    input["size"].is_number_unsigned())
+							{
+								size = input["size"].get<uint64_t>();
+							}
+							std::string file{string_field(input, "file")};
+							auto        index = addCheck(
+							  file,
+							  {std::string(string_field(input, "section_name")),
+							   size,
+							   std::string(string_field(input, "sha256"))});
+							inputs.push_back({name, kind, file, index});
+						}
+					}
+					if (finalFile && it->contains("output") &&
+					    (*it)["output"].is_object())
+					{
+						auto index = addCheck(
+						  *finalFile,
+						  {std::string(string_field(*it, "name")),
+						   std::nullopt,
+						   std::string(string_field((*it)["output"], "sha256"))});
+						outputs.push_back({name, kind, *finalFile, index});
+					}
+				}
+			}
+		}
+		std::optional<size_t> finalCheck;
+		if (finalFile && report.contains("final_hash"))
+		{
+			finalCheck = addCheck(
+			  *finalFile,
+			  {"",
+			   std::nullopt,
+			   std::string(string_field(report, "final_hash")),
+			   true});
+		}
+		std::vector<std::pair<const std::string, std::vector<Check>> *> work;
+		for (auto &entry : files)
+		{
+			work.push_back(&entry);
+		}
+		auto verifyFile = [&](const std::string   &file,
+		                      std::vector<Check> &checks) {
+			MappedFile mapped(buildDirectory / file);
+			if (!mapped.valid())
+			{
+				return;
+			}
+			auto sections = elf_sections(mapped.bytes());
+			// The hash of each section, computed when first needed.
+			std::vector<std::optional<std::string>> hashes(
+			  sections ? sections->size() : 0);
+			for (auto &check : checks)
+			{
+				if (check.wholeFile)
+				{
+					check.status = (sha256(mapped.bytes()) == check.sha256)
+					                 ? VerificationStatus::Match
+					                 : VerificationStatus::Mismatch;
+					continue;
+				}
+				// The null section has an empty name, so a check without a
+				// name must not match it.
+				if (!sections || check.sectionName.empty())
+				{
+					continue;
+				}
+				for (size_t i = 0; i < sections->size(); i++)
+				{
+					auto &section = (*sections)[i];
+					if (section.name != check.sectionName)
+					{
+						continue;
+					}
+					check.status = VerificationStatus::Mismatch;
+					if (check.size && (section.size != *check.size))
+					{
+						continue;
+					}
+					if (!hashes[i])
+					{
+						hashes[i] = section.contents
+						              ? sha256(*section.contents)
+						              : sha256_zeroes(section.size);
+					}
+					if (*hashes[i] == check.sha256)
+					{
+						check.status = VerificationStatus::Match;
+						break;
+					}
+				}
+			}
+		};
+		std::atomic<size_t> next = 0;
+		auto                worker = [&]() {
+			for (size_t i = next++; i < work.size(); i = next++)
+			{
+				verifyFile(work[i]->first, work[i]->second);
+			}
+		};
+		std::vector<std::thread> pool;
+		for (unsigned i = 1; i < std::min<size_t>(threads, work.size()); i++)
+		{
+			pool.emplace_back(worker);
+		}
+		worker();
+		for (auto &thread : pool)
+		{
+			thread.join();
+		}
+		nlohmann::json compartments = nlohmann::json::object();
+		bool           valid        = true;
+		// Record the status of a section in `entry` and add it to the
+		// `inputs` or `outputs` array of its compartment.
+		auto record = [&](const Section &section,
+		                  const char    *array,
+		                  nlohmann::json entry) {
+			auto &check       = files[section.file][section.index];
+			auto &compartment = compartments[section.compartment];
+			bool  matches     = check.status == VerificationStatus::Match;
+			if (compartment.is_null())
+			{
+				compartment = {{"valid", true},
+				               {"inputs", nlohmann::json::array()},
+				               {"outputs", nlohmann::json::array()}};
+			}
+			compartment["valid"] = compartment["valid"].get<bool>() && matches;
+			entry["kind"]         = section.kind;
+			entry["section_name"] = check.sectionName;
+			entry["status"]       = status_name(check.status);
+			compartment[array].push_back(std::move(entry));
+			valid = valid && matches;
+		};
+		for (auto &input : inputs)
+		{
+			record(input, "inputs", {{"file", input.file}});
+		}
+		for (auto &output : outputs)
+		{
+			record(output, "outputs", nlohmann::json::object());
+		}
+		auto finalStatus = finalCheck ? files[*finalFile][*finalCheck].status
+		                              : VerificationStatus::Missing;
+		return {{"compartments", compartments},
+		        {"final_hash", status_name(finalStatus)},
+		        {"valid", valid && (finalStatus == VerificationStatus::Match)}};
+	}
+} // namespace
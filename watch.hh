@@ -0,0 +1,243 @@
+// Copyright SCI Semiconductor and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <system_error>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#	include <poll.h>
+#	include <sys/inotify.h>
+#	include <unistd.h>
+#endif
+
+namespace
+{
+	/**
+	 * Watches a set of files for changes.  On Linux this uses inotify on the
+	 * directories containing the files, so that files that editors replace
+	 * by renaming a new copy over them are still seen.  Elsewhere, or if
+	 * inotify is not available, it polls the modification times of the
+	 * files.
+	 */
+	class FileWatcher
+	{
+		/// The files being watched, as returned by `normalise`.
+		std::set<std::filesystem::path> files;
+		/// The last modification time seen for each file, when polling.
+		std::map<std::filesystem::path, std::filesystem::file_time_type>
+		  times;
+		/// The inotify file descriptor, or -1 if polling.
+		int fd = -1;
+		/// The directory for each inotify watch descriptor.
+		std::map<int, std::filesystem::path> directories;
+
+		/**
+		 * How long to wait after a change for further changes, so that a
+		 * file written in several steps is reported once.
+		 */
+		static constexpr std::chrono::milliseconds SettleTime{50};
+
+		/**
+		 * How often to check modification times, when polling.
+		 */
+		static constexpr std::chrono::milliseconds PollInterval{250};
+
+		/**
+		 * Add any files whose modification times have changed since they
+		 * were last checked to `changed`.
+		 */
+		void check_times(std::set<std::filesystem::path> &changed)
+		{
+			for (auto &file : files)
+			{
+				std::error_code error;
+				auto time = std::filesystem::last_write_time(file, error);
+				if (!error && (times[file] != time))
+				{
+					times[file] = time;
+					changed.insert(file);
+				}
+			}
+		}
+
+#ifdef __linux__
+		/**
+		 * Read the pending inotify events, adding any watched files that
+		 * they refer to to `changed`.  Blocks if there are no pending
+		 * events.
+		 */
+		void read_events(std::set<std::filesystem::path> &changed)
+		{
+			alignas(inotify_event) char buffer[4096];
+			ssize_t length = read(fd, buffer, sizeof(buffer));
+			for (ssize_t offset = 0; offset < length;)
+			{
+				auto *event = reinterpret_cast<inotify_event *>(buffer + offset);
+				offset += sizeof(inotify_event) + event->len;
+				auto directory = directories.find(event->wd);
+				if ((event->len == 0) || (directory == directories.end()))
+				{
+					continue;
+				}
+				auto path = directory->second / event->name;
+				if (files.contains(path))
+				{
+					changed.insert(std::move(path));
+				}
+			}
+		}
+#endif
+
+		public:
+		/**
+		 * Returns the form of `path` that `wait` reports, for comparing
+		 * against its results.
+		 */
+		static std::filesystem::path normalise(const std::filesystem::path &path)
+		{
+			return std::filesystem::absolute(path).lexically_normal();
+		}
+
+		/**
+		 * Watch `paths`.
+		 */
+		explicit FileWatcher(const std::vector<std::filesystem::path> &paths)
+		{
+			for (auto &path : paths)
+			{
+				files.insert(normalise(path));
+			}
+#ifdef __linux__
+			fd = inotify_init1(IN_CLOEXEC);
+			for (auto &file : files)
+			{
+				auto directory = file.parent_path();
+				if ((fd < 0) ||
+				    std::any_of(directories.begin(),
+				                directories.end(),
+				                [&](auto &entry) {
+					                return entry.second == directory;
+				                }))
+				{
+					continue;
+				}
+				int wd = inotify_add_watch(
+				  fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+				if (wd < 0)
+				{
+					close(fd);
+					fd = -1;
+					break;
+				}
+				directories.emplace(wd, directory);
+			}
+#endif
+			if (fd < 0)
+			{
+				std::set<std::filesystem::path> ignored;
+				check_times(ignored);
+			}
+		}
+
+		FileWatcher(const FileWatcher &) = delete;
+
+		~FileWatcher()
+		{
+#ifdef __linux__
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+#endif
+		}
+
+		/**
+		 * Block until at least one of the files changes, and return the
+		 * files that changed, as returned by `normalise`.
+		 */
+		std::set<std::filesystem::path> wait()
+		{
+			std::set<std::filesystem::path> changed;
+#ifdef __linux__
+			if (fd >= 0)
+			{
+				while (changed.empty())
+				{
+					read_events(changed);
+				}
+				pollfd pending{fd, POLLIN, 0};
+				while (poll(&pending, 1, SettleTime.count()) > 0)
+				{
+					read_events(changed);
+				}
+				return changed;
+			}
+#endif
+			while (changed.empty())
+			{
+				std::this_thread::sleep_for(PollInterval);
+				check_times(changed);
+			}
+			std::this_thread::sleep_for(SettleTime);
+			check_times(changed);
+			return changed;
+		}
+	};
+
+	/**
+	 * The inputs that watch mode must reload after some files change.
+	 */
+	struct WatchReload
+	{
+		/// Parse the board description again.
+		bool board = false;
+		/// Read the modules again.
+		bool modules = false;
+		/// Load the firmware report again and rebuild its indexes.
+		bool report = false;
+		/// Create a new interpreter.
+		bool interpreter = false;
+		/// Read the query file again.
+		bool queries = false;
+	};
+
+	/**
+	 * Decide what watch mode must reload, given the set of files that
+	 * changed, as returned by `FileWatcher::wait`.  `haveContext` and
+	 * `haveImage` say whether the board description and modules, and the
+	 * firmware report, were loaded successfully last time.  Inputs that
+	 * failed to load are loaded again whenever anything changes.  The
+	 * indexes built with the report include the board description, so a
+	 * new board also requires the report to be loaded again, but new
+	 * modules only require a new interpreter.
+	 */
+	WatchReload
+	watch_reload(const std::set<std::filesystem::path>    &changed,
+	             const std::filesystem::path              &boardFile,
+	             const std::vector<std::filesystem::path> &moduleFiles,
+	             const std::filesystem::path              &reportFile,
+	             const std::filesystem::path              &queryFile,
+	             bool                                      haveContext,
+	             bool                                      haveImage)
+	{
+		auto changedAny = [&](const std::vector<std::filesystem::path> &files) {
+			return std::any_of(files.begin(), files.end(), [&](auto &file) {
+				return !file.empty() &&
+				       changed.contains(FileWatcher::normalise(file));
+			});
+		};
+		WatchReload reload;
+		reload.board   = !haveContext || changedAny({boardFile});
+		reload.modules = !haveContext || changedAny(moduleFiles);
+		reload.report =
+		  reload.board || !haveImage || changedAny({reportFile});
+		reload.interpreter = reload.modules || reload.report;
+		reload.queries     = changedAny({queryFile});
+		return reload;
+	}
+} // namespace